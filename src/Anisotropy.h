@@ -0,0 +1,481 @@
+//
+// Created by ChenhuiWang on 2024/5/25.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_ANISOTROPY_H
+#define CODEGRAPH_ANISOTROPY_H
+
+#include "KahanSum.h"
+#include "MortonOrder.h"
+#include "NeighborList.h"
+#include "ParticleArrays.h"
+#include "PassReport.h"
+#include "SmoothingKernels.h"
+#include "SpatialGrid.h"
+#include "SymEigen.h"
+#include "ThreadPool.h"
+#include "VerletList.h"
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct AnisotropyParams {
+    double h    = 25.0;   // smoothing length, neighbors are searched within 2h
+    double kr   = 4.0;    // largest allowed ratio between the first and any other axis
+    double kn   = 0.5;    // axes of particles with too few neighbors
+    int    nEps = 20;     // fewer neighbors than this keep an isotropic kernel
+    int    k    = 0;      // > 0: the support of every particle is its k nearest neighbors, h to
+                          // 4h, and particles need min(nEps, k) of them for an anisotropic kernel
+    KernelType kernel = KernelType::Cubic;   // weight of the neighbors in the covariance
+
+    bool operator==(const AnisotropyParams& other) const {
+        return h == other.h && kr == other.kr && kn == other.kn && nEps == other.nEps &&
+               k == other.k && kernel == other.kernel;
+    }
+
+    bool operator!=(const AnisotropyParams& other) const { return !(*this == other); }
+};
+
+template<int Dim> class Anisotropy {
+    /// Anisotropic kernels from weighted PCA of the neighborhoods (Yu and Turk, "Reconstructing
+    /// Surfaces of Particle-Based Fluids Using Anisotropic Kernels"). For every particle the
+    /// weighted covariance C = R diag(sigma) R^T of the neighbors within 2h is decomposed, the
+    /// axes are clamped to sigma_0 / kr and scaled to unit volume, and the kernel matrix is
+    /// G = R diag(1 / scale) R^T / h. Neighbors are weighted by params.kernel, a SmoothingKernels
+    /// policy. Every pass runs on gThreadPool and is logged as a PassReport.
+    /// The passes run on the points sorted along the Z curve (MortonOrder) unless that is turned
+    /// off, results are scattered back so every accessor takes the original index. The sorted
+    /// points are kept per axis as ParticleReal, which the Verlet filter and the moments read;
+    /// the grid and the k nearest search take a copy of them as vectors.
+    /// With params.k set the support adapts instead: it reaches the k-th nearest other particle,
+    /// between h and 4h (2h without k of them), and the particle's kernel takes half of it as its
+    /// smoothing length.
+    /// With a Verlet skin, frames of a sequence reuse the neighbor candidates of an earlier frame
+    /// (VerletList) until a particle moved more than half the skin, particles are matched by id.
+    /// In deterministic mode the neighbor lists are sorted by particle id (the original index
+    /// without ids) and the moments use Kahan summation, so a particle's kernel does not depend on
+    /// the file order, Morton order or candidate reuse.
+public:
+    using Vec = Eigen::Matrix<double, Dim, 1>;
+    using Mat = Eigen::Matrix<double, Dim, Dim>;
+
+    /// name and seconds per pass
+    using PassTimes = std::vector<std::pair<std::string, double>>;
+
+    void Compute(const std::vector<Vec>& input, const AnisotropyParams& params) {
+        int n         = (int)input.size();
+        mVerletReused = false;
+        mPassSeconds.clear();
+        // neighbors of consecutive particles are close in memory once they are sorted
+        PassReport mortonReport(mMortonOrder ? "morton" : "gather", n);
+        if (mMortonOrder) {
+            mMorton.Build(input);
+            mOrder = mMorton.Order();
+        } else {
+            mOrder.clear();
+        }
+        mSortedAxes.Resize(n);
+        for (int k = 0; k < n; k++) {
+            mSortedAxes.SetPosition(k, input[Order(k)]);
+        }
+        GatherPoints();
+        Finish(mortonReport);
+        Run(mSorted, params, nullptr, false);
+    }
+
+    /// the same from arrays per axis, gathered straight into Z order. ids, one per particle,
+    /// track the particles across frames for the Verlet skin, null takes the indices as ids.
+    template<typename Real>
+    void Compute(const ParticleArrays<Real, Dim>& input, const AnisotropyParams& params,
+                 const int* ids = nullptr) {
+        int  n      = input.Size();
+        bool verlet = mVerletSkin > 0.0 && params.k == 0;
+        // the order of the frame the candidates were built on is still close to Z order
+        mVerletReused = false;
+        mPassSeconds.clear();
+        if (verlet && mVerlet.Fits(2.0 * params.h, mVerletSkin) && mVerlet.Match(ids, n, mOrder)) {
+            PassReport verletReport("verlet", n);
+            Gather(input);
+            double displacement = mVerlet.MaxDisplacement(mSorted);
+            mVerletReused       = displacement <= 0.5 * mVerletSkin;
+            verletReport.AddCount(mVerletReused ? "reused" : "rebuilt", 1);
+            verletReport.AddCount("max displacement in % of the skin",
+                                  (long long)std::lround(100.0 * displacement / mVerletSkin));
+            Finish(verletReport);
+        }
+        if (!mVerletReused) {
+            PassReport  mortonReport(mMortonOrder ? "morton" : "gather", n);
+            const Real* axes[Dim];
+            for (int d = 0; d < Dim; d++) {
+                axes[d] = input.Axis(d);
+            }
+            if (mMortonOrder) {
+                mMorton.Build(n, axes, 1);
+                mOrder = mMorton.Order();
+            } else {
+                mOrder.clear();
+            }
+            Gather(input);
+            Finish(mortonReport);
+        }
+        Run(mSorted, params, ids, verlet);
+    }
+
+    int Size() const { return (int)mScale.size(); }
+
+    /// weighted mean of the neighborhood
+    const Vec& Mean(int i) const { return mMean[i]; }
+
+    /// singular values of the covariance, largest first
+    const Vec& Sigma(int i) const { return mSigma[i]; }
+
+    /// kernel axes after clamping and scaling, in the order of the columns of Rotate
+    const Vec& Scale(int i) const { return mScale[i]; }
+
+    /// principal axes as columns, a rotation
+    const Mat& Rotate(int i) const { return mRotate[i]; }
+
+    /// G, maps an offset from the particle to the argument of the isotropic kernel
+    const Mat& Kernel(int i) const { return mKernel[i]; }
+
+    /// all kernels, by original index
+    const std::vector<Mat>& Kernels() const { return mKernel; }
+
+    /// support radius of the neighborhood, 2h unless params.k is set
+    double Radius(int i) const { return mRadius[i]; }
+
+    /// neighbor lists of the sorted points: list i and the indices in it are positions in Order()
+    const NeighborList& Neighbors() const { return mNeighbors; }
+
+    /// original index of the k-th sorted point, the identity without Morton order
+    int Order(int k) const { return mOrder.empty() ? k : mOrder[k]; }
+
+    /// log a PassReport per pass, on by default. Off for long sequences.
+    void SetLogPasses(bool logPasses) { mLogPasses = logPasses; }
+
+    /// sort the points along the Z curve before the passes, on by default
+    void SetMortonOrder(bool mortonOrder) { mMortonOrder = mortonOrder; }
+
+    /// keep the neighbor candidates within 2h + skin across Compute calls from ParticleArrays
+    /// until a particle moved more than skin / 2. 0, the default, searches every frame anew.
+    void SetVerletSkin(double skin) {
+        mVerletSkin = skin;
+        mVerlet.Clear();
+    }
+
+    /// sort the neighbors by id and sum the moments compensated, off by default. Costs a sort of
+    /// every list per frame (per candidate rebuild with a Verlet skin) and a slower moments pass.
+    void SetDeterministic(bool deterministic) {
+        mDeterministic = deterministic;
+        mVerlet.Clear();
+    }
+
+    /// whether the last Compute filtered the candidates of an earlier frame
+    bool VerletReused() const { return mVerletReused; }
+
+    /// name and seconds of every pass of the last Compute, in the order they ran
+    const PassTimes& PassSeconds() const { return mPassSeconds; }
+
+private:
+    static constexpr int sParticleGrain = 256;   // every particle only writes its own entries
+    static constexpr int sPackedCount   = Dim * (Dim + 1) / 2;
+
+    /// the input in sorted order into mSortedAxes, one pass per axis, and mSorted
+    template<typename Real> void Gather(const ParticleArrays<Real, Dim>& input) {
+        int n = input.Size();
+        mSortedAxes.Resize(n);
+        for (int d = 0; d < Dim; d++) {
+            const Real*   src = input.Axis(d);
+            ParticleReal* dst = mSortedAxes.Axis(d);
+            for (int k = 0; k < n; k++) {
+                dst[k] = (ParticleReal)src[Order(k)];
+            }
+        }
+        GatherPoints();
+    }
+
+    /// mSorted from mSortedAxes, for the grid and the k nearest search
+    void GatherPoints() {
+        mSorted.resize(mSortedAxes.Size());
+        for (int k = 0; k < mSortedAxes.Size(); k++) {
+            mSorted[k] = mSortedAxes.Position(k);
+        }
+    }
+
+    /// the passes over points, which are already in Z order if that is on. ids of the original
+    /// order name the slots of new Verlet candidates.
+    void Run(const std::vector<Vec>& points, const AnisotropyParams& params, const int* ids,
+             bool verlet) {
+        int    n = (int)points.size();
+        double r = 2.0 * params.h;
+
+        // neighbors are never further than r, a grid with cells of size r only needs the cells
+        // around. Reused Verlet candidates need no grid.
+        if (!mVerletReused) {
+            PassReport gridReport("grid", n);
+            mGrid.Build(points, verlet ? r + mVerletSkin : r);
+            Finish(gridReport);
+        }
+
+        // every pair is found and weighted once, the passes below only read the lists
+        PassReport neighborReport(params.k > 0 ? "k nearest"
+                                  : verlet     ? (mVerletReused ? "verlet filter" : "verlet build")
+                                               : "neighbors",
+                                  n);
+        // one instantiation per kernel, the weight is inlined into the loops that build the lists
+        using NeighborPass = void (Anisotropy::*)(const std::vector<Vec>&, const AnisotropyParams&,
+                                                  const int*, bool, PassReport&);
+        static const NeighborPass sNeighborPasses[] = {
+            &Anisotropy::BuildNeighbors<CubicFalloffKernel>, &Anisotropy::BuildNeighbors<Poly6Kernel>,
+            &Anisotropy::BuildNeighbors<CubicSplineKernel>, &Anisotropy::BuildNeighbors<WendlandKernel>};
+        (this->*sNeighborPasses[(int)params.kernel])(points, params, ids, verlet, neighborReport);
+        neighborReport.Stop();
+        Histogram neighborCounts(0, 100, 10);
+        for (int i = 0; i < n; i++) {
+            neighborCounts.Add(mNeighbors.Count(i));
+        }
+        neighborReport.AddCount("pairs", mNeighbors.PairCount());
+        neighborReport.AddHistogram("neighbors per particle", neighborCounts);
+        if (params.k > 0) {
+            Histogram radii(0, 2, 10);
+            for (int i = 0; i < n; i++) {
+                radii.Add(mRadius[i] / r);
+            }
+            neighborReport.AddHistogram("support radius / 2h", radii);
+        }
+        Finish(neighborReport);
+
+        // ids are unique, so the order of a list no longer depends on how it was searched.
+        // Filtered Verlet candidates are in order already, they were sorted when built.
+        if (mDeterministic && !verlet) {
+            PassReport       orderReport("neighbor order", n);
+            std::vector<int> keys(n);
+            for (int k = 0; k < n; k++) {
+                keys[k] = ids ? ids[Order(k)] : Order(k);
+            }
+            mNeighbors.SortBy(keys);
+            Finish(orderReport);
+        }
+
+        // weighted mean and covariance in one pass, from the 0th, 1st and 2nd moments of the
+        // neighbors. Moments are taken relative to points[i] so the covariance does not lose
+        // precision to the subtraction of two large numbers. The upper triangle is stored packed,
+        // one array per entry, for the batched 2x2 eigensolver.
+        mMean.resize(n);
+        for (auto& entry : mPacked) {
+            entry.resize(n);
+        }
+        PassReport momentReport("moments", n);
+        ParallelFor(0, n, sParticleGrain, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                SPH_TRACE("x_weight, C: {}", i);
+                double weightTotal = 0.0;
+                Vec    m1          = Vec::Zero();
+                Mat    m2          = Mat::Zero();
+                if (mDeterministic) {
+                    KahanSum<double> sum0(0.0);
+                    KahanSum<Vec>    sum1(Vec::Zero());
+                    KahanSum<Mat>    sum2(Mat::Zero());
+                    for (int k = mNeighbors.Begin(i); k < mNeighbors.End(i); k++) {
+                        double w = mNeighbors.Weight(k);
+                        Vec    y = mSortedAxes.Offset(i, mNeighbors.Index(k));
+                        sum0.Add(w);
+                        sum1.Add(w * y);
+                        sum2.Add(w * y * y.transpose());
+                    }
+                    weightTotal = sum0.Sum();
+                    m1          = sum1.Sum();
+                    m2          = sum2.Sum();
+                } else {
+                    for (int k = mNeighbors.Begin(i); k < mNeighbors.End(i); k++) {
+                        double w = mNeighbors.Weight(k);
+                        Vec    y = mSortedAxes.Offset(i, mNeighbors.Index(k));
+                        weightTotal += w;
+                        m1 += w * y;
+                        m2 += w * y * y.transpose();
+                    }
+                }
+                Vec mean = m1 / weightTotal;
+                Mat C    = m2 / weightTotal - mean * mean.transpose();
+                mMean[i] = points[i] + mean;
+                for (int e = 0; e < sPackedCount; e++) {
+                    mPacked[e][i] = C(sPackedRow(e), sPackedColumn(e));
+                }
+            }
+        });
+        Finish(momentReport);
+
+        // C is symmetric positive semi-definite, its SVD is the eigen-decomposition
+        mSigma.resize(n);
+        mRotate.resize(n);
+        mScale.resize(n);
+        mKernel.resize(n);
+        int        minNeighbors = params.k > 0 ? std::min(params.nEps, params.k) : params.nEps;
+        PassReport svdReport("svd", n);
+        ParallelFor(0, n, sParticleGrain, [&](int begin, int end) {
+            Decompose(begin, end);
+            for (int i = begin; i < end; i++) {
+                SPH_TRACE("SVD: {}", i);
+                Vec    scale  = mSigma[i];
+                double first  = scale[0];
+                bool   sparse = mNeighbors.Count(i) < minNeighbors || !(first > 0.0);
+                if (sparse) {
+                    mRotate[i].setIdentity();
+                    scale.setConstant(params.kn);
+                } else {
+                    for (int d = 1; d < Dim; d++) {
+                        scale[d] = std::max(scale[d], first / params.kr);
+                    }
+                    scale /= std::pow(scale.prod(), 1.0 / Dim);
+                }
+                SPH_TRACE("{}  {}", scale[0], scale[Dim - 1]);
+                mScale[i]  = scale;
+                mKernel[i] = mRotate[i] * scale.cwiseInverse().asDiagonal() *
+                             mRotate[i].transpose() / (0.5 * mRadius[i]);
+            }
+        });
+        svdReport.Stop();
+        Histogram ratios(0, 1, 10);
+        int       isotropic = 0;
+        for (int i = 0; i < n; i++) {
+            ratios.Add(mSigma[i][0] > 0.0 ? std::max(mSigma[i][Dim - 1], 0.0) / mSigma[i][0] : 0.0);
+            isotropic += mNeighbors.Count(i) < minNeighbors;
+        }
+        svdReport.AddCount("isotropic (few neighbors)", isotropic);
+        svdReport.AddHistogram("singular value ratio last/first", ratios);
+        Finish(svdReport);
+
+        if (!mOrder.empty()) {
+            Unsort(mMean);
+            Unsort(mSigma);
+            Unsort(mRotate);
+            Unsort(mScale);
+            Unsort(mKernel);
+            Unsort(mRadius);
+        }
+    }
+
+    /// row and column of packed entry e, the upper triangle row by row: xx, xy, (xz,) yy, ...
+    static int sPackedRow(int e) {
+        int row = 0;
+        while (e >= Dim - row) {
+            e -= Dim - row;
+            row++;
+        }
+        return row;
+    }
+
+    static int sPackedColumn(int e) {
+        int row = sPackedRow(e);
+        return e - (row * Dim - row * (row - 1) / 2) + row;
+    }
+
+    /// the weighted neighbor lists and support radii of the points, weights from Kernel
+    template<typename Kernel>
+    void BuildNeighbors(const std::vector<Vec>& points, const AnisotropyParams& params,
+                        const int* ids, bool verlet, PassReport& report) {
+        int    n      = (int)points.size();
+        double r      = 2.0 * params.h;
+        auto   kernel = [r](double d) { return Kernel::Weight(d / r); };
+        if (params.k > 0) {
+            // supports between h and 4h, particles without k neighbors in reach keep 2h and so
+            // the same isotropic kernel as without params.k
+            mNeighbors.BuildNearest(
+                mGrid, points, params.k, params.h, 2.0 * r, r,
+                [](double d, double radius) { return Kernel::Weight(d / radius); }, mRadius);
+        } else if (verlet) {
+            if (!mVerletReused) {
+                std::vector<int> slotIds(n);
+                for (int k = 0; k < n; k++) {
+                    slotIds[k] = ids ? ids[Order(k)] : Order(k);
+                }
+                mVerlet.Rebuild(mGrid, points, std::move(slotIds), r, mVerletSkin);
+                if (mDeterministic) {
+                    mVerlet.SortById();
+                }
+            }
+            mNeighbors.Filter(mVerlet.Candidates(), mSortedAxes, r, kernel);
+            mRadius.assign(n, r);
+            report.AddCount("candidates", mVerlet.Candidates().PairCount());
+        } else {
+            mNeighbors.Build(mGrid, points, r, kernel);
+            mRadius.assign(n, r);
+        }
+    }
+
+    void Finish(PassReport& report) {
+        report.Stop();
+        mPassSeconds.emplace_back(report.Name(), report.Seconds());
+        if (mLogPasses) {
+            report.Log();
+        }
+    }
+
+    /// from sorted back to the original order
+    template<typename T> void Unsort(std::vector<T>& values) const {
+        std::vector<T> sorted;
+        sorted.swap(values);
+        values.resize(sorted.size());
+        for (size_t k = 0; k < sorted.size(); k++) {
+            values[mOrder[k]] = sorted[k];
+        }
+    }
+
+    /// eigen-decomposition of the packed covariances in [begin, end) into mSigma and mRotate
+    void Decompose(int begin, int end) {
+        if constexpr (Dim == 2) {
+            int                 count = end - begin;
+            std::vector<double> c(count), s(count), l0(count), l1(count);
+            sSymEigen2Batch(&mPacked[0][begin],
+                            &mPacked[1][begin],
+                            &mPacked[2][begin],
+                            count,
+                            l0.data(),
+                            l1.data(),
+                            c.data(),
+                            s.data());
+            for (int k = 0; k < count; k++) {
+                mSigma[begin + k] << l0[k], l1[k];
+                mRotate[begin + k] << c[k], -s[k], s[k], c[k];
+            }
+        } else {
+            static_assert(Dim == 3, "2D or 3D only");
+            for (int i = begin; i < end; i++) {
+                Mat C;
+                for (int e = 0; e < sPackedCount; e++) {
+                    C(sPackedRow(e), sPackedColumn(e)) = C(sPackedColumn(e), sPackedRow(e)) =
+                        mPacked[e][i];
+                }
+                sSymEigen3(C, mSigma[i], mRotate[i]);
+            }
+        }
+    }
+
+    bool                              mLogPasses     = true;
+    bool                              mMortonOrder   = true;
+    double                            mVerletSkin    = 0.0;
+    bool                              mVerletReused  = false;
+    bool                              mDeterministic = false;
+    MortonOrder<Dim>                  mMorton;
+    std::vector<int>                  mOrder;       // original index per sorted point, or empty
+    std::vector<Vec>                  mSorted;      // the input in Z order
+    ParticleArrays<ParticleReal, Dim> mSortedAxes;  // the same per axis, for the neighbor loops
+    VerletList<Dim>                   mVerlet;
+    SpatialGrid<Dim>                  mGrid;
+    NeighborList                      mNeighbors;
+    std::vector<double>               mPacked[sPackedCount];
+    std::vector<Vec>                  mMean;
+    std::vector<Vec>                  mSigma;
+    std::vector<Mat>                  mRotate;
+    std::vector<Vec>                  mScale;
+    std::vector<Mat>                  mKernel;
+    std::vector<double>               mRadius;
+    PassTimes                         mPassSeconds;
+};
+
+#endif   // CODEGRAPH_ANISOTROPY_H
@@ -0,0 +1,60 @@
+//
+// Created by ChenhuiWang on 2024/5/10.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_BOUNDEDQUEUE_H
+#define CODEGRAPH_BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+template<typename T> class BoundedQueue {
+    /// Blocking FIFO between pipeline stages, Push waits while it holds mCapacity items so a fast
+    /// producer cannot run ahead of the consumers
+public:
+    explicit BoundedQueue(size_t capacity)
+        : mCapacity(capacity) {}
+
+    /// returns false once the queue is closed
+    bool Push(T value) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNotFull.wait(lock, [this] { return mClosed || mItems.size() < mCapacity; });
+        if (mClosed)
+            return false;
+        mItems.push_back(std::move(value));
+        mNotEmpty.notify_one();
+        return true;
+    }
+
+    /// returns false when the queue is closed and drained
+    bool Pop(T& value) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNotEmpty.wait(lock, [this] { return mClosed || !mItems.empty(); });
+        if (mItems.empty())
+            return false;
+        value = std::move(mItems.front());
+        mItems.pop_front();
+        mNotFull.notify_one();
+        return true;
+    }
+
+    void Close() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mClosed = true;
+        mNotFull.notify_all();
+        mNotEmpty.notify_all();
+    }
+
+private:
+    std::mutex              mMutex;
+    std::condition_variable mNotFull;
+    std::condition_variable mNotEmpty;
+    std::deque<T>           mItems;
+    size_t                  mCapacity;
+    bool                    mClosed = false;
+};
+
+#endif   // CODEGRAPH_BOUNDEDQUEUE_H
@@ -0,0 +1,448 @@
+//
+// Created by ChenhuiWang on 2024/5/10.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_CALLSTACKIMPORTER_H
+#define CODEGRAPH_CALLSTACKIMPORTER_H
+
+#include "BoundedQueue.h"
+#include "CallTree.h"
+#include <sajson/sajson.h>
+#include <spdlog/spdlog.h>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string_view>
+#include <thread>
+
+/// Reads file in chunks of about chunkSize bytes that end on a line break and hands them to sink.
+/// Memory stays bounded by the chunk size plus the longest line.
+static bool sReadLineChunks(const std::string& file, size_t chunkSize,
+                            const std::function<void(std::string&&)>& sink) {
+    std::ifstream input(file, std::ios::binary);
+    if (!input.is_open()) {
+        spdlog::error("File not open: {}", file);
+        return false;
+    }
+    std::string carry;
+    while (input) {
+        std::string chunk = std::move(carry);
+        size_t      used  = chunk.size();
+        chunk.resize(used + chunkSize);
+        input.read(&chunk[used], (std::streamsize)chunkSize);
+        chunk.resize(used + (size_t)input.gcount());
+
+        auto last = chunk.rfind('\n');
+        if (last == std::string::npos) {
+            // no line break yet, keep reading into the same line
+            carry = std::move(chunk);
+            continue;
+        }
+        carry.assign(chunk, last + 1, std::string::npos);
+        chunk.resize(last + 1);
+        sink(std::move(chunk));
+    }
+    if (!carry.empty()) {
+        sink(std::move(carry));
+    }
+    return true;
+}
+
+static unsigned sImporterThreadCount() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+class FoldedStackImporter {
+    /// Folded stacks as written by stackcollapse-perf.pl from `perf script` output, one sample per
+    /// line: "comm;frame0;frame1;... count". Chunks are aggregated into per-thread trees which are
+    /// merged at the end, so memory depends on the number of distinct stacks, not on the file size.
+public:
+    bool Import(const std::string& file, CallTree& tree) const {
+        BoundedQueue<std::string> chunks(2 * mThreadCount);
+        std::vector<CallTree>     trees(mThreadCount);
+        std::vector<std::thread>  workers;
+        for (unsigned t = 0; t < mThreadCount; t++) {
+            workers.emplace_back([&chunks, &local = trees[t]] {
+                std::string chunk;
+                while (chunks.Pop(chunk)) {
+                    sAggregateChunk(chunk, local);
+                }
+            });
+        }
+
+        bool success =
+            sReadLineChunks(file, mChunkSize, [&chunks](std::string&& c) { chunks.Push(std::move(c)); });
+        chunks.Close();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (const auto& local : trees) {
+            tree.Merge(local);
+        }
+        return success;
+    }
+
+public:
+    size_t   mChunkSize   = 4 << 20;
+    unsigned mThreadCount = sImporterThreadCount();
+
+private:
+    static void sAggregateChunk(std::string_view chunk, CallTree& tree) {
+        while (!chunk.empty()) {
+            auto end  = chunk.find('\n');
+            auto line = chunk.substr(0, end);
+            chunk     = end == std::string_view::npos ? std::string_view() : chunk.substr(end + 1);
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+
+            // the sample count follows the last space, lines without it count once
+            double count = 1.0;
+            auto   space = line.rfind(' ');
+            if (space != std::string_view::npos) {
+                char*       parseEnd = nullptr;
+                std::string number(line.substr(space + 1));
+                double      value = std::strtod(number.c_str(), &parseEnd);
+                if (parseEnd && *parseEnd == '\0' && parseEnd != number.c_str()) {
+                    count = value;
+                    line  = line.substr(0, space);
+                }
+            }
+
+            int node = tree.Root();
+            tree.AddWeight(node, count);
+            while (!line.empty()) {
+                auto separator = line.find(';');
+                auto frame     = line.substr(0, separator);
+                line = separator == std::string_view::npos ? std::string_view()
+                                                           : line.substr(separator + 1);
+                node = tree.Child(node, frame);
+                tree.AddWeight(node, count);
+            }
+        }
+    }
+};
+
+class ChromeTraceImporter {
+    /// Chrome trace_event JSON, either a bare event array or an object with "traceEvents".
+    /// The file is cut into batches of whole events without parsing (TraceEventSplitter), batches
+    /// are parsed with sajson on a worker pool, and the events are then routed by thread to
+    /// aggregator threads that rebuild each thread's stack from B/E and X events.
+    /// Events of one thread are expected in timestamp order, as Chrome and most tracers write them.
+    /// Node weights are inclusive durations in microseconds.
+public:
+    struct TraceEvent {
+        std::string name;
+        char        phase;
+        uint64_t    thread;
+        double      ts;
+        double      dur;
+    };
+
+    using EventBatch = std::vector<TraceEvent>;
+
+    bool Import(const std::string& file, CallTree& tree) const {
+        std::ifstream input(file, std::ios::binary);
+        if (!input.is_open()) {
+            spdlog::error("File not open: {}", file);
+            return false;
+        }
+
+        unsigned                         shardCount = mThreadCount;
+        BoundedQueue<std::pair<long long, std::string>> rawBatches(2 * mThreadCount);
+        std::vector<std::unique_ptr<BoundedQueue<std::shared_ptr<EventBatch>>>> shardQueues;
+        for (unsigned s = 0; s < shardCount; s++) {
+            shardQueues.push_back(std::make_unique<BoundedQueue<std::shared_ptr<EventBatch>>>(4));
+        }
+
+        // parsed batches wait here until all earlier ones are routed, which keeps every thread's
+        // events in file order; parsers stall when they get too far ahead
+        std::mutex                      reorderMutex;
+        std::condition_variable         reorderCondition;
+        std::map<long long, EventBatch> parsed;
+        long long                       nextBatch = 0;
+        long long                       maxAhead  = 4 * (long long)mThreadCount;
+        bool                            parseFailed = false;
+
+        auto route = [&](EventBatch& batch) {
+            std::vector<std::shared_ptr<EventBatch>> shards(shardCount);
+            for (auto& event : batch) {
+                auto& shard = shards[event.thread % shardCount];
+                if (!shard) {
+                    shard = std::make_shared<EventBatch>();
+                }
+                shard->push_back(std::move(event));
+            }
+            for (unsigned s = 0; s < shardCount; s++) {
+                if (shards[s]) {
+                    shardQueues[s]->Push(std::move(shards[s]));
+                }
+            }
+        };
+
+        std::vector<std::thread> parsers;
+        for (unsigned t = 0; t < mThreadCount; t++) {
+            parsers.emplace_back([&] {
+                std::pair<long long, std::string> raw;
+                while (rawBatches.Pop(raw)) {
+                    EventBatch                   batch;
+                    bool                         valid = sParseBatch(raw.second, batch);
+                    std::unique_lock<std::mutex> lock(reorderMutex);
+                    parseFailed |= !valid;
+                    reorderCondition.wait(lock, [&] { return raw.first < nextBatch + maxAhead; });
+                    parsed.emplace(raw.first, std::move(batch));
+                    // whoever holds the next batch in order routes it and the ones after it
+                    while (!parsed.empty() && parsed.begin()->first == nextBatch) {
+                        auto ready = std::move(parsed.begin()->second);
+                        parsed.erase(parsed.begin());
+                        route(ready);
+                        nextBatch++;
+                    }
+                    reorderCondition.notify_all();
+                }
+            });
+        }
+
+        std::vector<CallTree>    trees(shardCount);
+        std::vector<std::thread> aggregators;
+        for (unsigned s = 0; s < shardCount; s++) {
+            aggregators.emplace_back([&queue = *shardQueues[s], &local = trees[s]] {
+                sAggregateEvents(queue, local);
+            });
+        }
+
+        TraceEventSplitter splitter(mBatchSize);
+        long long          batchIndex = 0;
+        auto               emit       = [&](std::string&& batch) {
+            rawBatches.Push({batchIndex++, std::move(batch)});
+        };
+        std::vector<char> block(mChunkSize);
+        while (input) {
+            input.read(block.data(), (std::streamsize)block.size());
+            splitter.Feed(block.data(), (size_t)input.gcount(), emit);
+        }
+        splitter.Finish(emit);
+
+        rawBatches.Close();
+        for (auto& parser : parsers) {
+            parser.join();
+        }
+        for (auto& queue : shardQueues) {
+            queue->Close();
+        }
+        for (auto& aggregator : aggregators) {
+            aggregator.join();
+        }
+        for (const auto& local : trees) {
+            tree.Merge(local);
+        }
+
+        if (parseFailed) {
+            spdlog::error("Chrome trace contains invalid JSON: {}", file);
+        }
+        return !parseFailed;
+    }
+
+public:
+    size_t   mChunkSize   = 4 << 20;
+    size_t   mBatchSize   = 4 << 20;
+    unsigned mThreadCount = sImporterThreadCount();
+
+private:
+    class TraceEventSplitter {
+        /// Byte level scanner that tracks strings and nesting to find the event objects in the
+        /// events array, and copies them into "[e0,e1,...]" batches of about batchSize bytes
+    public:
+        explicit TraceEventSplitter(size_t batchSize)
+            : mBatchSize(batchSize) {}
+
+        void Feed(const char* data, size_t size, const std::function<void(std::string&&)>& emit) {
+            size_t eventStart = 0;
+            for (size_t i = 0; i < size; i++) {
+                char c = data[i];
+                if (mInString) {
+                    if (mEscape) {
+                        mEscape = false;
+                    } else if (c == '\\') {
+                        mEscape = true;
+                    } else if (c == '"') {
+                        mInString = false;
+                        if (mCollectKey) {
+                            mLastKey    = mKey;
+                            mCollectKey = false;
+                        }
+                    } else if (mCollectKey) {
+                        mKey += c;
+                    }
+                    continue;
+                }
+
+                switch (c) {
+                case '"':
+                    mInString   = true;
+                    mCollectKey = !mInEvent && mDepth == 1 && mRootIsObject;
+                    mKey.clear();
+                    break;
+                case '{':
+                case '[':
+                    if (mDepth == 0) {
+                        mRootIsObject = c == '{';
+                        mEventsDepth  = c == '[' ? 1 : -1;
+                    } else if (c == '[' && mDepth == 1 && mRootIsObject &&
+                               mLastKey == "traceEvents") {
+                        mEventsDepth = 2;
+                    }
+                    if (c == '{' && mDepth == mEventsDepth) {
+                        mInEvent     = true;
+                        eventStart   = i;
+                        mEventOffset = mBatch.size();
+                        mBatch += mBatch.empty() ? '[' : ',';
+                    }
+                    mDepth++;
+                    break;
+                case '}':
+                case ']':
+                    mDepth--;
+                    if (c == '}' && mInEvent && mDepth == mEventsDepth) {
+                        mInEvent = false;
+                        mBatch.append(data + eventStart, i + 1 - eventStart);
+                        if (mBatch.size() >= mBatchSize) {
+                            Finish(emit);
+                        }
+                    }
+                    if (c == ']' && mDepth == mEventsDepth - 1) {
+                        mEventsDepth = -1;
+                    }
+                    break;
+                default: break;
+                }
+            }
+            if (mInEvent) {
+                // the event continues in the next block
+                mBatch.append(data + eventStart, size - eventStart);
+            }
+        }
+
+        /// emit the pending batch, an event cut off by the end of the file is dropped
+        void Finish(const std::function<void(std::string&&)>& emit) {
+            if (mInEvent) {
+                mBatch.resize(mEventOffset);
+                mInEvent = false;
+            }
+            if (!mBatch.empty()) {
+                mBatch += ']';
+                emit(std::move(mBatch));
+                mBatch.clear();
+            }
+        }
+
+    private:
+        size_t      mBatchSize;
+        std::string mBatch;
+        std::string mKey;
+        std::string mLastKey;
+        size_t      mEventOffset  = 0;
+        int         mDepth        = 0;
+        int         mEventsDepth  = -1;
+        bool        mRootIsObject = false;
+        bool        mInString     = false;
+        bool        mEscape       = false;
+        bool        mCollectKey   = false;
+        bool        mInEvent      = false;
+    };
+
+    static uint64_t sIdOf(const sajson::value& value) {
+        if (value.get_type() == sajson::TYPE_INTEGER || value.get_type() == sajson::TYPE_DOUBLE) {
+            return (uint64_t)value.get_number_value();
+        }
+        if (value.get_type() == sajson::TYPE_STRING) {
+            return std::hash<std::string>()(value.as_string());
+        }
+        return 0;
+    }
+
+    static bool sParseBatch(std::string& text, EventBatch& batch) {
+        auto document = sajson::parse(sajson::dynamic_allocation(),
+                                      sajson::mutable_string_view(text.size(), &text[0]));
+        if (!document.is_valid()) {
+            spdlog::error("sajson: {} at line {}",
+                          document.get_error_message_as_string(),
+                          document.get_error_line());
+            return false;
+        }
+        auto root = document.get_root();
+        batch.reserve(root.get_length());
+        for (size_t i = 0; i < root.get_length(); i++) {
+            auto event = root.get_array_element(i);
+            if (event.get_type() != sajson::TYPE_OBJECT)
+                continue;
+            auto phase = event.get_value_of_key(sajson::literal("ph"));
+            if (phase.get_type() != sajson::TYPE_STRING || phase.get_string_length() != 1)
+                continue;
+            char ph = phase.as_cstring()[0];
+            if (ph != 'B' && ph != 'E' && ph != 'X')
+                continue;
+            auto name = event.get_value_of_key(sajson::literal("name"));
+            auto ts   = event.get_value_of_key(sajson::literal("ts"));
+            auto dur  = event.get_value_of_key(sajson::literal("dur"));
+            bool hasTs = ts.get_type() == sajson::TYPE_INTEGER || ts.get_type() == sajson::TYPE_DOUBLE;
+            bool hasDur =
+                dur.get_type() == sajson::TYPE_INTEGER || dur.get_type() == sajson::TYPE_DOUBLE;
+            if (!hasTs || (ph == 'X' && !hasDur))
+                continue;
+
+            TraceEvent record;
+            record.name   = name.get_type() == sajson::TYPE_STRING ? name.as_string() : "";
+            record.phase  = ph;
+            record.thread = sIdOf(event.get_value_of_key(sajson::literal("pid"))) * 1000003 ^
+                            sIdOf(event.get_value_of_key(sajson::literal("tid")));
+            record.ts     = ts.get_number_value();
+            record.dur    = hasDur ? dur.get_number_value() : 0.0;
+            batch.push_back(std::move(record));
+        }
+        return true;
+    }
+
+    static void sAggregateEvents(BoundedQueue<std::shared_ptr<EventBatch>>& queue, CallTree& tree) {
+        struct OpenFrame {
+            int    node;
+            double begin;
+            double end;   // infinity for B events, closed by their E event
+        };
+        std::unordered_map<uint64_t, std::vector<OpenFrame>> stacks;
+
+        std::shared_ptr<EventBatch> batch;
+        while (queue.Pop(batch)) {
+            for (const auto& event : *batch) {
+                auto& stack = stacks[event.thread];
+                // complete events that ended before this one are no longer on the stack
+                while (!stack.empty() && stack.back().end <= event.ts) {
+                    stack.pop_back();
+                }
+                int parent = stack.empty() ? tree.Root() : stack.back().node;
+                if (event.phase == 'B') {
+                    stack.push_back({tree.Child(parent, event.name),
+                                     event.ts,
+                                     std::numeric_limits<double>::infinity()});
+                } else if (event.phase == 'E') {
+                    if (!stack.empty()) {
+                        tree.AddWeight(stack.back().node, event.ts - stack.back().begin);
+                        stack.pop_back();
+                    }
+                } else {
+                    int node = tree.Child(parent, event.name);
+                    tree.AddWeight(node, event.dur);
+                    stack.push_back({node, event.ts, event.ts + event.dur});
+                }
+            }
+        }
+    }
+};
+
+#endif   // CODEGRAPH_CALLSTACKIMPORTER_H
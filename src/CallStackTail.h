@@ -0,0 +1,70 @@
+//
+// Created by ChenhuiWang on 2024/5/16.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_CALLSTACKTAIL_H
+#define CODEGRAPH_CALLSTACKTAIL_H
+
+#include "HierarchyCallStack.h"
+#include <filesystem>
+#include <fstream>
+
+class CallStackTail {
+    /// Follows a txt description that keeps growing (tail -f). Every Poll reads only the bytes
+    /// appended since the previous one and hands the complete lines to
+    /// HierarchyCallStack::AppendTxt, an unfinished last line waits for its newline. At most
+    /// mMaxBytesPerPoll are read at once so a large backlog is caught up over several frames.
+    /// A file that got shorter was rewritten, Poll reports it and starts over from its beginning.
+public:
+    enum class Status { Unchanged, Appended, Truncated };
+
+    explicit CallStackTail(std::string file, size_t maxBytesPerPoll = 16 << 20)
+        : mFile(std::move(file))
+        , mMaxBytesPerPoll(maxBytesPerPoll) {}
+
+    Status Poll(HierarchyCallStack& cs) {
+        std::error_code ec;
+        auto            size = std::filesystem::file_size(mFile, ec);
+        if (ec || size == mOffset)
+            return Status::Unchanged;
+        if (size < mOffset) {
+            mOffset = 0;
+            mPartial.clear();
+            return Status::Truncated;
+        }
+
+        std::ifstream input(mFile, std::ios::binary);
+        if (!input.is_open()) {
+            spdlog::error("File not open: {}", mFile);
+            return Status::Unchanged;
+        }
+        input.seekg((std::streamoff)mOffset);
+        auto count = (size_t)std::min<uintmax_t>(size - mOffset, mMaxBytesPerPoll);
+        mBuffer    = mPartial;
+        mBuffer.resize(mPartial.size() + count);
+        input.read(&mBuffer[mPartial.size()], (std::streamsize)count);
+        count = (size_t)input.gcount();
+        mBuffer.resize(mPartial.size() + count);
+        mOffset += count;
+
+        size_t end = mBuffer.rfind('\n');
+        if (end == std::string::npos) {
+            mPartial.swap(mBuffer);
+            return Status::Unchanged;
+        }
+        cs.AppendTxt(std::string_view(mBuffer).substr(0, end + 1));
+        mPartial.assign(mBuffer, end + 1, std::string::npos);
+        return Status::Appended;
+    }
+
+private:
+    std::string mFile;
+    size_t      mMaxBytesPerPoll;
+    uintmax_t   mOffset = 0;   // bytes consumed, including mPartial
+    std::string mPartial;      // start of a line without its newline yet
+    std::string mBuffer;
+};
+
+#endif   // CODEGRAPH_CALLSTACKTAIL_H
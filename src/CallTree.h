@@ -0,0 +1,167 @@
+//
+// Created by ChenhuiWang on 2024/5/10.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_CALLTREE_H
+#define CODEGRAPH_CALLTREE_H
+
+#include "StringTable.h"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class CallTree {
+    /// Prefix trie of call stacks: identical frames under the same parent are merged into one node
+    /// that carries the inclusive weight (samples or microseconds) of everything below it.
+    /// Frame names are interned to 32-bit ids, and the (parent, frame id) -> child lookup is an
+    /// open addressing table, so inserting a sample costs one integer hash probe per frame.
+    /// Node 0 is an unnamed root, children keep the order in which they were first seen.
+public:
+    struct Node {
+        uint32_t frame;
+        int      parent;
+        int      firstChild  = -1;
+        int      lastChild   = -1;
+        int      nextSibling = -1;
+        double   weight      = 0.0;   // inclusive
+    };
+
+    CallTree() {
+        mNodes.push_back({Intern(""), -1});
+        mSlots.assign(1024, sEmptySlot);
+    }
+
+    int Root() const { return 0; }
+
+    const Node& GetNode(int node) const { return mNodes[node]; }
+
+    int NodeCount() const { return (int)mNodes.size(); }
+
+    uint32_t Intern(std::string_view name) { return mFrames.Intern(name); }
+
+    std::string_view FrameName(uint32_t frame) const { return mFrames.Get(frame); }
+
+    const StringTable& Frames() const { return mFrames; }
+
+    int Child(int parent, uint32_t frame) {
+        uint64_t key  = sKey(parent, frame);
+        size_t   mask = mSlots.size() - 1;
+        for (size_t i = sHash(key) & mask;; i = (i + 1) & mask) {
+            if (mSlots[i].key == key)
+                return mSlots[i].node;
+            if (mSlots[i].key == sEmptyKey) {
+                int node = (int)mNodes.size();
+                mNodes.push_back({frame, parent});
+                auto& p = mNodes[parent];
+                if (p.lastChild < 0) {
+                    p.firstChild = node;
+                } else {
+                    mNodes[p.lastChild].nextSibling = node;
+                }
+                p.lastChild = node;
+                mSlots[i]   = {key, node};
+                // keep the load factor under 1/2 so probe sequences stay short
+                if (2 * mNodes.size() > mSlots.size()) {
+                    Rehash(2 * mSlots.size());
+                }
+                return node;
+            }
+        }
+    }
+
+    int Child(int parent, std::string_view name) { return Child(parent, Intern(name)); }
+
+    void AddWeight(int node, double weight) { mNodes[node].weight += weight; }
+
+    /// weight of node that is not spent in its children
+    double SelfWeight(int node) const {
+        double self = mNodes[node].weight;
+        for (int c = mNodes[node].firstChild; c >= 0; c = mNodes[c].nextSibling) {
+            self -= mNodes[c].weight;
+        }
+        return self;
+    }
+
+    /// merge other into this tree, frames of other that already exist here are added up
+    void Merge(const CallTree& other) {
+        std::vector<uint32_t> frames(other.mFrames.Size());
+        for (uint32_t f = 0; f < frames.size(); f++) {
+            frames[f] = Intern(other.mFrames.Get(f));
+        }
+        std::vector<int> mapping(other.mNodes.size(), 0);
+        mNodes[0].weight += other.mNodes[0].weight;
+        // parents always precede their children in mNodes
+        for (int i = 1; i < (int)other.mNodes.size(); i++) {
+            const auto& node = other.mNodes[i];
+            mapping[i]       = Child(mapping[node.parent], frames[node.frame]);
+            AddWeight(mapping[i], node.weight);
+        }
+    }
+
+    /// depth first pre-order walk, the root is not visited and top level frames have level 0
+    void Visit(const std::function<void(const Node&, int level)>& visitor) const {
+        std::vector<std::pair<int, int>> stack;
+        auto                             pushChildren = [&](int node, int level) {
+            // reversed, so the first child is popped first
+            size_t begin = stack.size();
+            for (int c = mNodes[node].firstChild; c >= 0; c = mNodes[c].nextSibling) {
+                stack.emplace_back(c, level);
+            }
+            std::reverse(stack.begin() + (long)begin, stack.end());
+        };
+        pushChildren(0, 0);
+        while (!stack.empty()) {
+            auto [node, level] = stack.back();
+            stack.pop_back();
+            visitor(mNodes[node], level);
+            pushChildren(node, level + 1);
+        }
+    }
+
+private:
+    struct Slot {
+        uint64_t key;
+        int      node;
+    };
+
+    static constexpr uint64_t sEmptyKey = ~0ull;
+    static constexpr Slot     sEmptySlot{sEmptyKey, -1};
+
+    static uint64_t sKey(int parent, uint32_t frame) {
+        return ((uint64_t)(uint32_t)parent << 32) | frame;
+    }
+
+    static size_t sHash(uint64_t key) {
+        // splitmix64 finalizer: every bit of parent and frame reaches the low bits the mask keeps
+        key ^= key >> 30;
+        key *= 0xBF58476D1CE4E5B9ull;
+        key ^= key >> 27;
+        key *= 0x94D049BB133111EBull;
+        key ^= key >> 31;
+        return (size_t)key;
+    }
+
+    void Rehash(size_t capacity) {
+        std::vector<Slot> slots(capacity, sEmptySlot);
+        size_t            mask = capacity - 1;
+        for (const auto& slot : mSlots) {
+            if (slot.key == sEmptyKey)
+                continue;
+            size_t i = sHash(slot.key) & mask;
+            while (slots[i].key != sEmptyKey) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = slot;
+        }
+        mSlots.swap(slots);
+    }
+
+    std::vector<Node> mNodes;
+    std::vector<Slot> mSlots;
+    StringTable       mFrames;
+};
+
+#endif   // CODEGRAPH_CALLTREE_H
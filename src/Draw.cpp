@@ -5,8 +5,10 @@
 //
 
 #include "Draw.h"
+#include "Profiler.h"
 #include <spdlog/spdlog.h>
 #include <imgui/imgui.h>
+#include <cmath>
 
 #define BUFFER_OFFSET(x) ((const void*)(x))
 
@@ -82,6 +84,31 @@ Vec2 Camera::ConvertWorldToScreen(const Vec2& pw) {
     return ps;
 }
 
+Vec2 Camera::ConvertScreenToWorld(const Vec2& ps) {
+    Vec2 extents = Vec2{mWidth / 2.f, mHeight / 2.f} * mZoom;
+    return mCenter +
+           Vec2{ps.x / (float)mWidth * 2.f - 1.f, 1.f - ps.y / (float)mHeight * 2.f} * extents;
+}
+
+bool Camera::UpdateFromMouse() {
+    ImGuiIO& io = ImGui::GetIO();
+    if (io.WantCaptureMouse)
+        return false;
+    bool moved = false;
+    if (io.MouseWheel != 0.f) {
+        Vec2 cursor{io.MousePos.x, io.MousePos.y};
+        Vec2 anchor = ConvertScreenToWorld(cursor);
+        mZoom *= std::pow(0.9f, io.MouseWheel);
+        mCenter += anchor - ConvertScreenToWorld(cursor);
+        moved = true;
+    }
+    if (ImGui::IsMouseDragging(0)) {
+        mCenter -= Vec2{io.MouseDelta.x, -io.MouseDelta.y} * mZoom;
+        moved = true;
+    }
+    return moved;
+}
+
 static void sPrintLog(GLuint object) {
     GLint logLength = 0;
     if (glIsShader(object)) {
@@ -155,12 +182,15 @@ template<typename T> static void sSetUniform(GLint location, const T& value) {
         glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
     } else if constexpr (std::is_same_v<T, Vec2>) {
         glUniform2fv(location, 1, glm::value_ptr(value));
+    } else if constexpr (std::is_same_v<T, Vec4>) {
+        glUniform4fv(location, 1, glm::value_ptr(value));
     } else if constexpr (std::is_same_v<T, float>) {
         glUniform1f(location, value);
     }
 }
 template void sSetUniform<Mat4>(GLint, const Mat4&);
 template void sSetUniform<Vec2>(GLint, const Vec2&);
+template void sSetUniform<Vec4>(GLint, const Vec4&);
 template void sSetUniform<float>(GLint, const float&);
 
 
@@ -261,6 +291,9 @@ public:
         if (mCount == 0)
             return;
 
+        PROFILE_SCOPE("GLRenderPointsImpl::Flush");
+        PROFILE_GPU_SCOPE("GLRenderPointsImpl::Flush");
+
         glUseProgram(mProgramId);
 
         Mat4 proj;
@@ -392,6 +425,9 @@ public:
         if (mCount == 0)
             return;
 
+        PROFILE_SCOPE("GLRenderLinesImpl::Flush");
+        PROFILE_GPU_SCOPE("GLRenderLinesImpl::Flush");
+
         glUseProgram(mProgramId);
 
         Mat4 proj;
@@ -476,7 +512,7 @@ public:
             GL_ARRAY_BUFFER, (int)sizeof(Vec2) * mMaxVertices, mVertices.data(), GL_DYNAMIC_DRAW);
 
         glBindBuffer(GL_ARRAY_BUFFER, mVboIds[1]);
-        glVertexAttribPointer(mVertexAttribute, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
+        glVertexAttribPointer(mColorAttribute, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
         glBufferData(
             GL_ARRAY_BUFFER, (int)sizeof(Color4) * mMaxVertices, mColors.data(), GL_DYNAMIC_DRAW);
 
@@ -495,7 +531,7 @@ public:
     void Destroy() {
         if (mVaoId) {
             glDeleteVertexArrays(1, &mVaoId);
-            glDeleteBuffers(3, mVboIds);
+            glDeleteBuffers(2, mVboIds);
             mVaoId = 0;
         }
 
@@ -518,6 +554,9 @@ public:
         if (mCount == 0)
             return;
 
+        PROFILE_SCOPE("GLRenderTrianglesImpl::Flush");
+        PROFILE_GPU_SCOPE("GLRenderTrianglesImpl::Flush");
+
         glUseProgram(mProgramId);
 
         Mat4 proj;
@@ -561,6 +600,290 @@ public:
 };
 
 
+class GLRenderLineBufferImpl {
+    /// Retained GL_LINES, see LineBuffer. mVertices/mColors only hold the pending vertices
+public:
+    void Create() {
+        const char* vs = "#version 330\n"
+                         "uniform mat4 projectionMatrix;\n"
+                         "layout(location = 0) in vec2 v_position;\n"
+                         "layout(location = 1) in vec4 v_color;\n"
+                         "out vec4 f_color;\n"
+                         "void main(void)\n"
+                         "{\n"
+                         "	f_color = v_color;\n"
+                         "	gl_Position =  projectionMatrix * vec4(v_position, 0.0f, 1.0f);\n"
+                         "}\n";
+
+        const char* fs = "#version 330\n"
+                         "in vec4 f_color;\n"
+                         "out vec4 color;\n"
+                         "void main(void)\n"
+                         "{\n"
+                         "	color = f_color;\n"
+                         "}\n";
+
+        mProgramId         = sCreateShaderProgram(vs, fs);
+        mProjectionUniform = glGetUniformLocation(mProgramId, "projectionMatrix");
+        mVertexAttribute   = 0;
+        mColorAttribute    = 1;
+
+        glGenVertexArrays(1, &mVaoId);
+        glBindVertexArray(mVaoId);
+        glEnableVertexAttribArray(mVertexAttribute);
+        glEnableVertexAttribArray(mColorAttribute);
+        glBindVertexArray(0);
+
+        mResident = 0;
+        mCapacity = 0;
+        Reserve(mInitialCapacity);
+    }
+
+    void Destroy() {
+        if (mVaoId) {
+            glDeleteVertexArrays(1, &mVaoId);
+            glDeleteBuffers(2, mVboIds);
+            mVaoId     = 0;
+            mVboIds[0] = mVboIds[1] = 0;
+        }
+
+        if (mProgramId) {
+            glDeleteProgram(mProgramId);
+            mProgramId = 0;
+        }
+    }
+
+    void AddVertex(const Vec2& v, const Color4& c) {
+        mVertices.push_back(v);
+        mColors.push_back(c);
+    }
+
+    void Clear() {
+        mVertices.clear();
+        mColors.clear();
+        mResident = 0;
+    }
+
+    void Flush() {
+        if (!mVaoId) {
+            Create();
+        }
+
+        PROFILE_SCOPE("GLRenderLineBufferImpl::Flush");
+        PROFILE_GPU_SCOPE("GLRenderLineBufferImpl::Flush");
+
+        int pending = (int)mVertices.size();
+        if (pending > 0) {
+            Reserve(mResident + pending);
+            glBindBuffer(GL_ARRAY_BUFFER, mVboIds[0]);
+            glBufferSubData(GL_ARRAY_BUFFER,
+                            mResident * (int)sizeof(Vec2),
+                            pending * (int)sizeof(Vec2),
+                            mVertices.data());
+            glBindBuffer(GL_ARRAY_BUFFER, mVboIds[1]);
+            glBufferSubData(GL_ARRAY_BUFFER,
+                            mResident * (int)sizeof(Color4),
+                            pending * (int)sizeof(Color4),
+                            mColors.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            mResident += pending;
+            mVertices.clear();
+            mColors.clear();
+        }
+        if (mResident == 0)
+            return;
+
+        glUseProgram(mProgramId);
+
+        Mat4 proj;
+        gCamera.BuildProjectionMatrix(proj, 0.f);
+        sSetUniform(mProjectionUniform, proj);
+
+        glBindVertexArray(mVaoId);
+        glDrawArrays(GL_LINES, 0, mResident);
+        sCheckGLError();
+
+        glBindVertexArray(0);
+        glUseProgram(0);
+    }
+
+    /// grow both VBOs to hold at least count vertices, keeping the resident ones
+    void Reserve(int count) {
+        if (count <= mCapacity)
+            return;
+        int capacity = std::max(count, 2 * mCapacity);
+
+        glBindVertexArray(mVaoId);
+        GLsizei sizes[2]      = {(int)sizeof(Vec2), (int)sizeof(Color4)};
+        GLint   components[2] = {2, 4};
+        GLint   attributes[2] = {mVertexAttribute, mColorAttribute};
+        for (int k = 0; k < 2; k++) {
+            GLuint vbo;
+            glGenBuffers(1, &vbo);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+            glBufferData(GL_COPY_WRITE_BUFFER, capacity * sizes[k], nullptr, GL_STATIC_DRAW);
+            if (mVboIds[k]) {
+                glBindBuffer(GL_COPY_READ_BUFFER, mVboIds[k]);
+                glCopyBufferSubData(
+                    GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, mResident * sizes[k]);
+                glDeleteBuffers(1, &mVboIds[k]);
+            }
+            mVboIds[k] = vbo;
+
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glVertexAttribPointer(
+                attributes[k], components[k], GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
+        }
+        sCheckGLError();
+
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        mCapacity = capacity;
+    }
+
+
+public:
+    std::vector<Vec2>   mVertices;
+    std::vector<Color4> mColors;
+    int                 mResident        = 0;
+    int                 mCapacity        = 0;
+    int                 mInitialCapacity = 64 * 1024;
+    GLuint              mVaoId           = 0;
+    GLuint              mVboIds[2]       = {0, 0};
+    GLuint              mProgramId       = 0;
+    GLint               mProjectionUniform;
+    GLint               mVertexAttribute;
+    GLint               mColorAttribute;
+};
+
+
+class GLRenderPointBufferImpl {
+    /// Retained GL_POINTS, see PointBuffer. The VBO holds the caller's buffer byte for byte
+public:
+    void Create() {
+        const char* vs = "#version 330\n"
+                         "uniform mat4 projectionMatrix;\n"
+                         "uniform vec2 scale;\n"
+                         "uniform vec2 offset;\n"
+                         "uniform float size;\n"
+                         "layout(location = 0) in vec2 v_position;\n"
+                         "void main(void)\n"
+                         "{\n"
+                         "	gl_Position = projectionMatrix * vec4(scale * v_position + offset, 0.0f, 1.0f);\n"
+                         "	gl_PointSize = size;\n"
+                         "}\n";
+
+        const char* fs = "#version 330\n"
+                         "uniform vec4 pointColor;\n"
+                         "out vec4 color;\n"
+                         "void main(void)\n"
+                         "{\n"
+                         "	color = pointColor;\n"
+                         "}\n";
+
+        mProgramId         = sCreateShaderProgram(vs, fs);
+        mProjectionUniform = glGetUniformLocation(mProgramId, "projectionMatrix");
+        mScaleUniform      = glGetUniformLocation(mProgramId, "scale");
+        mOffsetUniform     = glGetUniformLocation(mProgramId, "offset");
+        mSizeUniform       = glGetUniformLocation(mProgramId, "size");
+        mColorUniform      = glGetUniformLocation(mProgramId, "pointColor");
+        mVertexAttribute   = 0;
+
+        glGenVertexArrays(1, &mVaoId);
+        glGenBuffers(1, &mVboId);
+        glBindVertexArray(mVaoId);
+        glEnableVertexAttribArray(mVertexAttribute);
+        glBindVertexArray(0);
+        mCount = 0;
+    }
+
+    void Destroy() {
+        if (mVaoId) {
+            glDeleteVertexArrays(1, &mVaoId);
+            glDeleteBuffers(1, &mVboId);
+            mVaoId = 0;
+            mVboId = 0;
+        }
+
+        if (mProgramId) {
+            glDeleteProgram(mProgramId);
+            mProgramId = 0;
+        }
+        mCount = 0;
+    }
+
+    void Upload(const float* data, int count, int stride) {
+        if (!mVaoId) {
+            Create();
+        }
+
+        PROFILE_SCOPE("GLRenderPointBufferImpl::Upload");
+
+        // from the first x to the last y, padding between points comes along
+        auto bytes = count > 0 ? (GLsizeiptr)(((size_t)(count - 1) * stride + 2) * sizeof(float)) : 0;
+        glBindVertexArray(mVaoId);
+        glBindBuffer(GL_ARRAY_BUFFER, mVboId);
+        glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
+        glVertexAttribPointer(mVertexAttribute,
+                              2,
+                              GL_FLOAT,
+                              GL_FALSE,
+                              stride * (int)sizeof(float),
+                              BUFFER_OFFSET(0));
+        sCheckGLError();
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        mCount = count;
+    }
+
+    void Flush() {
+        if (mCount == 0)
+            return;
+
+        PROFILE_SCOPE("GLRenderPointBufferImpl::Flush");
+        PROFILE_GPU_SCOPE("GLRenderPointBufferImpl::Flush");
+
+        glUseProgram(mProgramId);
+
+        Mat4 proj;
+        gCamera.BuildProjectionMatrix(proj, 0.f);
+        sSetUniform(mProjectionUniform, proj);
+        sSetUniform(mScaleUniform, mScale);
+        sSetUniform(mOffsetUniform, mOffset);
+        sSetUniform(mSizeUniform, mSize);
+        sSetUniform(mColorUniform, mColor);
+
+        glBindVertexArray(mVaoId);
+        glEnable(GL_PROGRAM_POINT_SIZE);
+        glDrawArrays(GL_POINTS, 0, mCount);
+        glDisable(GL_PROGRAM_POINT_SIZE);
+        sCheckGLError();
+
+        glBindVertexArray(0);
+        glUseProgram(0);
+    }
+
+
+public:
+    Vec2   mScale     = {1.f, 1.f};
+    Vec2   mOffset    = {0.f, 0.f};
+    Color4 mColor     = {1.f, 1.f, 1.f, 1.f};
+    float  mSize      = 1.f;
+    int    mCount     = 0;
+    GLuint mVaoId     = 0;
+    GLuint mVboId     = 0;
+    GLuint mProgramId = 0;
+    GLint  mProjectionUniform;
+    GLint  mScaleUniform;
+    GLint  mOffsetUniform;
+    GLint  mSizeUniform;
+    GLint  mColorUniform;
+    GLint  mVertexAttribute;
+};
+
+
 Draw::Draw() {
     mPointsImpl    = nullptr;
     mLinesImpl     = nullptr;
@@ -601,6 +924,15 @@ void Draw::DrawPolygon(const std::vector<Vec2>& vertices, const Vec4& color) {
     }
 }
 
+void Draw::DrawSolidPolygon(const std::vector<Vec2>& vertices, const Vec4& color) {
+    // triangle fan around the first vertex
+    for (int i = 1; i + 1 < vertices.size(); i++) {
+        mTrianglesImpl->AddVertex(vertices[0], color);
+        mTrianglesImpl->AddVertex(vertices[i], color);
+        mTrianglesImpl->AddVertex(vertices[i + 1], color);
+    }
+}
+
 void Draw::DrawCircle(const Vec2& center, float radius, const Vec4& color, const TV& scale, const TM& rotate) {
     int segment = 36;
     for(int i = 0; i < segment; i++){
@@ -623,7 +955,7 @@ void Draw::DrawCircle(const Vec2& center, float radius, const Vec4& color, const
 }
 
 void Draw::DrawString(const Vec2& p,
-                      const std::string& str,
+                      std::string_view str,
                       int fontSize,
                       const Color4& color) {
     auto ps = gCamera.ConvertWorldToScreen(p);
@@ -639,7 +971,7 @@ void Draw::DrawString(const Vec2& p,
                      ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoScrollbar);
     ImGui::SetCursorPos(ImVec2(ps.x, ps.y));
     ImGui::TextColored(ImColor(color.x , color.y, color.z, color.w),
-                       "%s", str.c_str());
+                       "%.*s", (int)str.size(), str.data());
     ImGui::End();
     ImGui::PopFont();
 }
@@ -650,3 +982,84 @@ void Draw::Flush() {
     mLinesImpl->Flush();
     mPointsImpl->Flush();
 }
+
+
+LineBuffer::LineBuffer()
+    : mImpl(std::make_unique<GLRenderLineBufferImpl>()) {}
+
+LineBuffer::~LineBuffer() {
+    if (mImpl) {
+        mImpl->Destroy();
+    }
+}
+
+LineBuffer::LineBuffer(LineBuffer&&) noexcept = default;
+
+LineBuffer& LineBuffer::operator=(LineBuffer&& other) noexcept {
+    if (this != &other) {
+        if (mImpl) {
+            mImpl->Destroy();
+        }
+        mImpl = std::move(other.mImpl);
+    }
+    return *this;
+}
+
+void LineBuffer::AddLine(const Vec2& p0, const Vec2& p1, const Color4& color) {
+    mImpl->AddVertex(p0, color);
+    mImpl->AddVertex(p1, color);
+}
+
+void LineBuffer::Clear() {
+    mImpl->Clear();
+}
+
+void LineBuffer::Flush() {
+    mImpl->Flush();
+}
+
+int LineBuffer::VertexCount() const {
+    return mImpl->mResident + (int)mImpl->mVertices.size();
+}
+
+
+PointBuffer::PointBuffer()
+    : mImpl(std::make_unique<GLRenderPointBufferImpl>()) {}
+
+PointBuffer::~PointBuffer() {
+    if (mImpl) {
+        mImpl->Destroy();
+    }
+}
+
+PointBuffer::PointBuffer(PointBuffer&&) noexcept = default;
+
+PointBuffer& PointBuffer::operator=(PointBuffer&& other) noexcept {
+    if (this != &other) {
+        if (mImpl) {
+            mImpl->Destroy();
+        }
+        mImpl = std::move(other.mImpl);
+    }
+    return *this;
+}
+
+void PointBuffer::Upload(const float* data, int count, int stride, const Vec2& scale,
+                         const Vec2& offset) {
+    mImpl->mScale  = scale;
+    mImpl->mOffset = offset;
+    mImpl->Upload(data, count, stride);
+}
+
+void PointBuffer::SetStyle(const Color4& color, float size) {
+    mImpl->mColor = color;
+    mImpl->mSize  = size;
+}
+
+void PointBuffer::Flush() {
+    mImpl->Flush();
+}
+
+int PointBuffer::PointCount() const {
+    return mImpl->mCount;
+}
@@ -13,6 +13,7 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <Eigen/Dense>
 
 using TV = Eigen::Vector2d;
@@ -28,6 +29,11 @@ public:
 
     void BuildProjectionMatrix(Mat4& m, float zBias);
     Vec2 ConvertWorldToScreen(const Vec2& pw);
+    Vec2 ConvertScreenToWorld(const Vec2& ps);
+
+    /// wheel zooms around the cursor, dragging with the left button pans. Mouse input ImGui
+    /// wants is left alone. true if the view moved
+    bool UpdateFromMouse();
 
 public:
     Vec2  mCenter;
@@ -39,6 +45,8 @@ public:
 class GLRenderPointsImpl;
 class GLRenderLinesImpl;
 class GLRenderTrianglesImpl;
+class GLRenderLineBufferImpl;
+class GLRenderPointBufferImpl;
 
 class Draw {
     /// use p-impl to reduce build dependency
@@ -55,9 +63,12 @@ public:
 
     void DrawPolygon(const std::vector<Vec2>& vertices, const Vec4& color);
 
+    /// filled convex polygon, blended with its alpha
+    void DrawSolidPolygon(const std::vector<Vec2>& vertices, const Vec4& color);
+
     void DrawCircle(const Vec2& center, float radius, const Vec4& color, const TV& scale = TV::Zero(), const TM& rotate = TM::Zero());
 
-    void DrawString(const Vec2& p, const std::string& str, int fontSize = 14,
+    void DrawString(const Vec2& p, std::string_view str, int fontSize = 14,
                     const Color4& color = {230, 153, 153, 255});
 
     void Flush();
@@ -70,6 +81,58 @@ public:
     std::unique_ptr<GLRenderTrianglesImpl> mTrianglesImpl;
 };
 
+class LineBuffer {
+    /// Lines that stay on the GPU between frames. Geometry is only ever appended: Flush uploads
+    /// the vertices added since the previous Flush behind the resident ones and draws all of them
+    /// in one call. When the VBO is full it doubles, the resident part is copied on the GPU.
+    /// GL objects are created by the first Flush, the context must outlive the buffer.
+public:
+    LineBuffer();
+    ~LineBuffer();
+    LineBuffer(LineBuffer&&) noexcept;
+    LineBuffer& operator=(LineBuffer&&) noexcept;
+
+    void AddLine(const Vec2& p0, const Vec2& p1, const Color4& color);
+
+    /// drop everything, resident or not
+    void Clear();
+
+    void Flush();
+
+    /// vertices resident on the GPU or waiting for the next Flush
+    int VertexCount() const;
+
+private:
+    std::unique_ptr<GLRenderLineBufferImpl> mImpl;
+};
+
+class PointBuffer {
+    /// Points that stay on the GPU, uploaded in bulk from a strided float buffer such as a Partio
+    /// attribute. The buffer is copied as it is in one glBufferData, the vertex shader reads x and
+    /// y at the given stride and maps them to world space with scale and offset, so no per-point
+    /// work happens on the CPU. All points share one color and size.
+    /// GL objects are created by the first Upload, the context must outlive the buffer.
+public:
+    PointBuffer();
+    ~PointBuffer();
+    PointBuffer(PointBuffer&&) noexcept;
+    PointBuffer& operator=(PointBuffer&&) noexcept;
+
+    /// count points with x at data[i * stride] and y at data[i * stride + 1], e.g. the float3
+    /// positions of a particle cache with stride 3. Replaces the previous points.
+    void Upload(const float* data, int count, int stride, const Vec2& scale = {1.f, 1.f},
+                const Vec2& offset = {0.f, 0.f});
+
+    void SetStyle(const Color4& color, float size);
+
+    void Flush();
+
+    int PointCount() const;
+
+private:
+    std::unique_ptr<GLRenderPointBufferImpl> mImpl;
+};
+
 extern Camera gCamera;
 extern Draw   gDraw;
 
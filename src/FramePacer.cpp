@@ -0,0 +1,85 @@
+//
+// Created by ChenhuiWang on 2024/5/6.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#include "FramePacer.h"
+#include "GLFW/glfw3.h"
+#include <algorithm>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#    include <immintrin.h>
+#endif
+
+static inline void sCpuRelax() {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// never sleep closer to the deadline than this, the OS scheduler is not precise enough
+static const FramePacer::Duration sMinSpinMargin(0.001);
+
+FramePacer::FramePacer(double targetHz, int historySize)
+    : mTarget(1.0 / targetHz)
+    , mSpinMargin(sMinSpinMargin)
+    , mFrameTime(0.0)
+    , mFrameStart(Clock::now())
+    , mVsync(false)
+    , mHistory(std::max(historySize, 1), 0.0)   // the ring index is taken modulo its size
+    , mHistoryHead(0)
+    , mHistoryCount(0) {}
+
+void FramePacer::SetTargetRate(double hz) {
+    mTarget = Duration(1.0 / hz);
+}
+
+void FramePacer::SetVsync(bool enabled) {
+    mVsync = enabled;
+    glfwSwapInterval(enabled ? 1 : 0);
+}
+
+void FramePacer::BeginFrame() {
+    mFrameStart = Clock::now();
+}
+
+void FramePacer::sSpinUntil(Clock::time_point deadline) {
+    while (Clock::now() < deadline) {
+        sCpuRelax();
+    }
+}
+
+void FramePacer::EndFrame() {
+    if (!mVsync) {
+        auto deadline = mFrameStart + std::chrono::duration_cast<Clock::duration>(mTarget);
+        auto wakeUp   = deadline - std::chrono::duration_cast<Clock::duration>(mSpinMargin);
+        if (Clock::now() < wakeUp) {
+            std::this_thread::sleep_until(wakeUp);
+            // Keep the margin around twice the typical oversleep, using a low pass filter
+            Duration overSleep = Clock::now() - wakeUp;
+            mSpinMargin        = std::max(sMinSpinMargin, 0.9 * mSpinMargin + 0.2 * overSleep);
+        }
+        sSpinUntil(deadline);
+    }
+
+    mFrameTime = Clock::now() - mFrameStart;
+
+    mHistory[mHistoryHead] = mFrameTime.count();
+    mHistoryHead           = (mHistoryHead + 1) % (int)mHistory.size();
+    mHistoryCount          = std::min(mHistoryCount + 1, (int)mHistory.size());
+}
+
+double FramePacer::Percentile(double p) const {
+    if (mHistoryCount == 0)
+        return 0.0;
+    mScratch.assign(mHistory.begin(), mHistory.begin() + mHistoryCount);
+    auto k = (size_t)std::clamp(p / 100.0 * (mHistoryCount - 1), 0.0, mHistoryCount - 1.0);
+    std::nth_element(mScratch.begin(), mScratch.begin() + k, mScratch.end());
+    return mScratch[k];
+}
@@ -0,0 +1,52 @@
+//
+// Created by ChenhuiWang on 2024/5/6.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_FRAMEPACER_H
+#define CODEGRAPH_FRAMEPACER_H
+
+#include <chrono>
+#include <vector>
+
+class FramePacer {
+    /// Caps the frame rate with a coarse sleep followed by a spin-wait for the last ~1ms, and keeps
+    /// a history of frame times for percentiles. With vsync on, glfwSwapBuffers does the pacing.
+public:
+    using Clock    = std::chrono::steady_clock;
+    using Duration = std::chrono::duration<double>;
+
+    explicit FramePacer(double targetHz = 60.0, int historySize = 240);
+
+    void SetTargetRate(double hz);
+
+    /// needs a current GL context
+    void SetVsync(bool enabled);
+    bool IsVsync() const { return mVsync; }
+
+    void BeginFrame();
+
+    /// wait for the frame deadline and record the frame time
+    void EndFrame();
+
+    Duration FrameTime() const { return mFrameTime; }
+
+    /// percentile in [0, 100] of the recorded frame times, in seconds
+    double Percentile(double p) const;
+
+private:
+    static void sSpinUntil(Clock::time_point deadline);
+
+    Duration                    mTarget;
+    Duration                    mSpinMargin;
+    Duration                    mFrameTime;
+    Clock::time_point           mFrameStart;
+    bool                        mVsync;
+    std::vector<double>         mHistory;
+    int                         mHistoryHead;
+    int                         mHistoryCount;
+    mutable std::vector<double> mScratch;
+};
+
+#endif   // CODEGRAPH_FRAMEPACER_H
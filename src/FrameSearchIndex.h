@@ -0,0 +1,189 @@
+//
+// Created by ChenhuiWang on 2024/5/14.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_FRAMESEARCHINDEX_H
+#define CODEGRAPH_FRAMESEARCHINDEX_H
+
+#include "StringTable.h"
+#include <algorithm>
+#include <cctype>
+#include <regex>
+
+class FrameSearchIndex {
+    /// Case insensitive trigram index over the distinct names of a StringTable. Postings are kept
+    /// as one sorted (trigram, id) array in CSR form. A query intersects the posting lists of its
+    /// trigrams, shortest first, and only the surviving names are compared, so the cost depends on
+    /// the number of distinct names, never on how many frames use them.
+    /// Queries take the table the index was built from. Names interned after Build are not
+    /// indexed yet, queries scan them until NeedsRebuild says the unindexed tail got too long.
+public:
+    void Build(const StringTable& names) {
+        mNameCount = names.Size();
+        std::vector<std::pair<uint32_t, uint32_t>> pairs;   // (trigram, name id)
+        std::vector<uint32_t>                      trigrams;
+        for (uint32_t id = 0; id < names.Size(); id++) {
+            sTrigrams(names.Get(id), trigrams);
+            for (uint32_t trigram : trigrams) {
+                pairs.emplace_back(trigram, id);
+            }
+        }
+        std::sort(pairs.begin(), pairs.end());
+
+        mKeys.clear();
+        mOffsets.clear();
+        mIds.resize(pairs.size());
+        for (size_t i = 0; i < pairs.size(); i++) {
+            if (mKeys.empty() || mKeys.back() != pairs[i].first) {
+                mKeys.push_back(pairs[i].first);
+                mOffsets.push_back((uint32_t)i);
+            }
+            mIds[i] = pairs[i].second;
+        }
+        mOffsets.push_back((uint32_t)pairs.size());
+    }
+
+    /// whether names grew enough since Build that scanning the new ones costs more than a rebuild
+    bool NeedsRebuild(const StringTable& names) const {
+        return names.Size() - mNameCount > std::max(1024u, mNameCount / 4);
+    }
+
+    /// ids (from first on) of the names that contain query, ignoring case
+    std::vector<uint32_t> FindSubstring(const StringTable& names, std::string_view query,
+                                        uint32_t first = 0) const {
+        std::string           lower = sLower(query);
+        std::vector<uint32_t> result;
+        for (uint32_t id : Candidates(lower, first, names.Size())) {
+            if (sContainsLower(names.Get(id), lower)) {
+                result.push_back(id);
+            }
+        }
+        return result;
+    }
+
+    /// ids (from first on) of the names that match the ECMAScript pattern at their start,
+    /// ignoring case. The literal text the pattern starts with narrows the candidates.
+    std::vector<uint32_t> FindRegexPrefix(const StringTable& names, const std::string& pattern,
+                                          uint32_t first = 0) const {
+        std::vector<uint32_t> result;
+        std::regex            regex;
+        try {
+            regex = std::regex(pattern, std::regex::ECMAScript | std::regex::icase);
+        } catch (const std::regex_error&) {
+            return result;
+        }
+        for (uint32_t id : Candidates(sLower(sLiteralPrefix(pattern)), first, names.Size())) {
+            auto name = names.Get(id);
+            if (std::regex_search(
+                    name.begin(), name.end(), regex, std::regex_constants::match_continuous)) {
+                result.push_back(id);
+            }
+        }
+        return result;
+    }
+
+private:
+    static std::string sLower(std::string_view str) {
+        std::string lower(str);
+        for (char& c : lower) {
+            c = (char)std::tolower((unsigned char)c);
+        }
+        return lower;
+    }
+
+    /// whether str contains lower (already lower case), ignoring the case of str
+    static bool sContainsLower(std::string_view str, std::string_view lower) {
+        auto it = std::search(str.begin(), str.end(), lower.begin(), lower.end(), [](char a, char b) {
+            return (char)std::tolower((unsigned char)a) == b;
+        });
+        return it != str.end() || lower.empty();
+    }
+
+    static uint32_t sTrigram(const char* c) {
+        return (uint32_t)(unsigned char)std::tolower((unsigned char)c[0]) << 16 |
+               (uint32_t)(unsigned char)std::tolower((unsigned char)c[1]) << 8 |
+               (uint32_t)(unsigned char)std::tolower((unsigned char)c[2]);
+    }
+
+    static void sTrigrams(std::string_view str, std::vector<uint32_t>& trigrams) {
+        trigrams.clear();
+        for (size_t i = 0; i + 3 <= str.size(); i++) {
+            trigrams.push_back(sTrigram(str.data() + i));
+        }
+        std::sort(trigrams.begin(), trigrams.end());
+        trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    }
+
+    /// characters up to the first regex operator, a quantified last character is dropped
+    static std::string sLiteralPrefix(const std::string& pattern) {
+        static const std::string sMeta = "\\^$.|?*+()[]{}";
+        if (pattern.find('|') != std::string::npos)
+            return "";   // alternatives share no prefix
+        size_t                   start = !pattern.empty() && pattern[0] == '^' ? 1 : 0;
+        size_t                   end   = pattern.find_first_of(sMeta, start);
+        if (end == std::string::npos) {
+            end = pattern.size();
+        } else if (end > start && std::string_view("?*{").find(pattern[end]) != std::string::npos) {
+            end--;
+        }
+        return pattern.substr(start, end - start);
+    }
+
+    /// ids in [first, count) that contain every trigram of literal (all of them for short
+    /// literals), sorted. Ids from mNameCount on are not indexed and always candidates.
+    std::vector<uint32_t> Candidates(const std::string& literal, uint32_t first,
+                                     uint32_t count) const {
+        std::vector<uint32_t> result;
+        if (literal.size() < 3) {
+            for (uint32_t id = first; id < count; id++) {
+                result.push_back(id);
+            }
+            return result;
+        }
+        auto appendUnindexed = [&]() {
+            for (uint32_t id = std::max(first, mNameCount); id < count; id++) {
+                result.push_back(id);
+            }
+        };
+
+        std::vector<uint32_t> trigrams;
+        sTrigrams(literal, trigrams);
+        std::vector<std::pair<uint32_t, uint32_t>> lists;   // [begin, end) in mIds
+        for (uint32_t trigram : trigrams) {
+            auto it = std::lower_bound(mKeys.begin(), mKeys.end(), trigram);
+            if (it == mKeys.end() || *it != trigram) {
+                appendUnindexed();
+                return result;
+            }
+            size_t k = it - mKeys.begin();
+            lists.emplace_back(mOffsets[k], mOffsets[k + 1]);
+        }
+        std::sort(lists.begin(), lists.end(), [](const auto& a, const auto& b) {
+            return a.second - a.first < b.second - b.first;
+        });
+
+        result.assign(mIds.begin() + lists[0].first, mIds.begin() + lists[0].second);
+        std::vector<uint32_t> next;
+        for (size_t l = 1; l < lists.size() && !result.empty(); l++) {
+            next.clear();
+            std::set_intersection(result.begin(),
+                                  result.end(),
+                                  mIds.begin() + lists[l].first,
+                                  mIds.begin() + lists[l].second,
+                                  std::back_inserter(next));
+            result.swap(next);
+        }
+        result.erase(result.begin(), std::lower_bound(result.begin(), result.end(), first));
+        appendUnindexed();
+        return result;
+    }
+
+    uint32_t              mNameCount = 0;
+    std::vector<uint32_t> mKeys;
+    std::vector<uint32_t> mOffsets;
+    std::vector<uint32_t> mIds;
+};
+
+#endif   // CODEGRAPH_FRAMESEARCHINDEX_H
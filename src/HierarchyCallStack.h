@@ -8,6 +8,11 @@
 #define CODEGRAPH_HIERARCHYCALLSTACK_H
 
 #include "HybridDraw.h"
+#include "Profiler.h"
+#include "CallStackImporter.h"
+#include "StringTable.h"
+#include "FrameSearchIndex.h"
+#include "RowPyramid.h"
 #include <fstream>
 #include <unordered_map>
 
@@ -17,7 +22,7 @@ std::vector<Vec4> gColorPlateRed{Red1, Red2, Red3, Red4, Red5};
 std::vector<Vec4> gColorPlateBlue{Blue1, Blue2, Blue3, Blue4, Blue5, Blue6};
 std::vector<Vec4> gColorPlate = gColorPlateDefault;
 
-static int sCountTabsInLine(const std::string& line) {
+static int sCountTabsInLine(std::string_view line) {
     int count = 0;
     for (char c : line) {
         if (c == ' ') {
@@ -30,12 +35,23 @@ static int sCountTabsInLine(const std::string& line) {
 }
 
 struct Func {
-    Func(const std::string& name, int level)
+    Func(uint32_t name, int level, double weight = 1.0)
         : name(name)
-        , level(level) {}
+        , level(level)
+        , weight(weight) {}
 
-    std::string name;
-    int         level;
+    uint32_t name;     // id in HierarchyCallStack::mNames
+    int      level;
+    double   weight;   // inclusive samples (or microseconds), used by the flame graph
+};
+
+enum class CallStackLayout { List, FlameGraph };
+
+struct SearchResult {
+    int    names        = 0;    // distinct names that match
+    int    hits         = 0;    // frames using them
+    int    first        = -1;   // first matching frame
+    double milliseconds = 0.0;
 };
 
 class HierarchyCallStack {
@@ -44,50 +60,455 @@ public:
 
     void ReadTxt(const std::string& file, int version = 1);
 
-    void Draw() const;
+    /// parse more lines of the txt format, text has to end at a line boundary
+    void AppendTxt(std::string_view text);
+
+    int FuncCount() const { return (int)mFuncs.size(); }
+
+    /// Chrome trace_event JSON, identical frames of all threads are merged
+    void ReadChromeTrace(const std::string& file);
+
+    /// folded stacks from `perf script | stackcollapse-perf.pl`
+    void ReadFoldedStacks(const std::string& file);
+
+    /// Merge identical frames under the same parent, every leaf line counts as one sample
+    void Aggregate();
+
+    void Draw(CallStackLayout layout = CallStackLayout::List) const;
+
+    /// index the frame names for Search, call after loading
+    void BuildSearchIndex();
+
+    /// highlight every frame whose name contains query (or matches the regex at its start).
+    /// The search stays active, frames appended later are matched as they come in.
+    SearchResult Search(const std::string& query, bool regexPrefix = false);
+
+    const SearchResult& LastSearch() const { return mSearchResult; }
+
+    /// next highlighted frame after func, wrapping around; -1 without matches
+    int NextHit(int after) const;
+
+    /// move the camera to func
+    void Focus(int func, CallStackLayout layout) const;
 
 private:
+    void ReadCallTree(const CallTree& tree);
+
+    void ParseTxtLine(std::string_view line);
+
+    /// extend the search state to the frames from firstFunc and names from firstName on
+    void UpdateSearch(int firstFunc, uint32_t firstName);
+
+    Vec2 ListPosition(int i) const;
+
+    /// extend the flame graph offsets to the frames appended since the last call
+    void UpdateFlameOffsets() const;
+
+    /// left end and width of the flame graph box of frame i, from the retained offsets
+    Vec2 FlamePosition(int i, float& width) const;
+
+    /// [first, last) of the list rows that intersect the view
+    void VisibleRows(int& first, int& last) const;
+
+    Color4 FuncColor(int i) const;
+
+    /// drop the retained boxes and the LOD blocks, after colors or rows changed
+    void InvalidateGeometry();
+
+    void DrawList() const;
+
+    /// rows smaller than a pixel: one band per block of the RowPyramid level that fits
+    void DrawListBands() const;
+
+    /// one row per level, box widths proportional to the inclusive weight
+    void DrawFlameGraph() const;
+
     std::vector<Func> mFuncs;
+    StringTable       mNames;
+
+    FrameSearchIndex     mSearchIndex;
+    bool                 mSearchIndexed = false;
+    std::vector<int>     mFirstUse;   // per name id: first frame using it
+    std::vector<int>     mUseCount;   // per name id
+    std::vector<uint8_t> mMatched;    // per name id, empty without a search
+    std::string          mQuery;
+    bool                 mQueryRegex = false;
+    SearchResult         mSearchResult;
+
+    // the list boxes never move, they are uploaded once and new rows are appended
+    mutable LineBuffer mRowBoxes;
+    mutable int        mBoxedFuncs = 0;
+    mutable RowPyramid mRowPyramid;
+
+    // flame graph layout in weight units, it only grows with appended frames and is scaled to
+    // the window when read
+    mutable std::vector<double> mFlameOffsets;   // per frame: weight left of it on its level
+    mutable std::vector<double> mFlameCursor;    // per level: next free offset
+    mutable double              mFlameTotal = 0.0;   // weight of the top level frames
 };
 
 void HierarchyCallStack::ReadTxt(const std::string& file, int version) {
+    PROFILE_SCOPE("Parse");
     std::string   absolutePath = file;
     std::ifstream inputFile(absolutePath);
     if (!inputFile.is_open()) {
         spdlog::error("File not open: {}", absolutePath);
         return;
     }
+    int         firstFunc = (int)mFuncs.size();
+    uint32_t    firstName = mNames.Size();
     std::string line;
     while (std::getline(inputFile, line)) {
         if (version == 1) {
-            if (line.empty())
-                continue;
-            auto level = sCountTabsInLine(line) / 4;
-            auto start = line.find_first_not_of(' ');
-            std::string realStr = line.substr(start);
-            if(realStr.size() >= 2 && realStr.substr(0, 2) == "//"){
-                continue;
-            }
-            mFuncs.emplace_back(realStr, level);
-//            auto start = std::find_if(line.begin(), line.end(), [](char c) { return c != ' '; });
-//            mFuncs.emplace_back(line.substr(std::distance(line.begin(), start)), level);
+            ParseTxtLine(line);
         }
     }
     inputFile.close();
+    UpdateSearch(firstFunc, firstName);
 }
 
+void HierarchyCallStack::AppendTxt(std::string_view text) {
+    PROFILE_SCOPE("Parse");
+    int      firstFunc = (int)mFuncs.size();
+    uint32_t firstName = mNames.Size();
+    while (!text.empty()) {
+        size_t end = text.find('\n');
+        if (end == std::string_view::npos) {
+            end = text.size();
+        }
+        ParseTxtLine(text.substr(0, end));
+        text.remove_prefix(std::min(end + 1, text.size()));
+    }
+    UpdateSearch(firstFunc, firstName);
+}
 
+void HierarchyCallStack::ParseTxtLine(std::string_view line) {
+    auto start = line.find_first_not_of(' ');
+    if (start == std::string_view::npos)
+        return;
+    auto level   = sCountTabsInLine(line) / 4;
+    auto realStr = line.substr(start);
+    if (realStr.size() >= 2 && realStr.substr(0, 2) == "//") {
+        return;
+    }
+    mFuncs.emplace_back(mNames.Intern(realStr), level);
+}
 
-void HierarchyCallStack::Draw() const {
-    Vec2  startPos = {50, 750};
-    Vec2  p        = startPos;
-    float width    = 0;
+void HierarchyCallStack::ReadChromeTrace(const std::string& file) {
+    PROFILE_SCOPE("Parse");
+    CallTree tree;
+    ChromeTraceImporter().Import(file, tree);
+    ReadCallTree(tree);
+}
+
+void HierarchyCallStack::ReadFoldedStacks(const std::string& file) {
+    PROFILE_SCOPE("Parse");
+    CallTree tree;
+    FoldedStackImporter().Import(file, tree);
+    ReadCallTree(tree);
+}
+
+void HierarchyCallStack::ReadCallTree(const CallTree& tree) {
+    std::vector<uint32_t> names(tree.Frames().Size());
+    for (uint32_t f = 0; f < names.size(); f++) {
+        names[f] = mNames.Intern(tree.FrameName(f));
+    }
+    mFuncs.reserve(mFuncs.size() + tree.NodeCount() - 1);
+    tree.Visit([&](const CallTree::Node& node, int level) {
+        mFuncs.emplace_back(names[node.frame], level, node.weight);
+    });
+}
+
+void HierarchyCallStack::Aggregate() {
+    CallTree              tree;
+    std::vector<uint32_t> frames(mNames.Size(), StringTable::sInvalidId);   // mNames id -> tree id
+    std::vector<int>      path;   // node of each level above the current line
     for (int i = 0; i < mFuncs.size(); i++) {
+        auto& frame = frames[mFuncs[i].name];
+        if (frame == StringTable::sInvalidId) {
+            frame = tree.Intern(mNames.Get(mFuncs[i].name));
+        }
+        // a line indented deeper than its predecessor allows hangs below the deepest frame
+        int level = std::min(mFuncs[i].level, (int)path.size());
+        path.resize(level);
+        path.push_back(tree.Child(level == 0 ? tree.Root() : path.back(), frame));
+
+        bool isLeaf = i + 1 == mFuncs.size() || mFuncs[i + 1].level <= mFuncs[i].level;
+        if (isLeaf) {
+            tree.AddWeight(tree.Root(), mFuncs[i].weight);
+            for (int node : path) {
+                tree.AddWeight(node, mFuncs[i].weight);
+            }
+        }
+    }
+    mFuncs.clear();
+    mNames = StringTable();
+    InvalidateGeometry();
+    ReadCallTree(tree);
+}
+
+void HierarchyCallStack::Draw(CallStackLayout layout) const {
+    if (layout == CallStackLayout::FlameGraph) {
+        DrawFlameGraph();
+    } else {
+        DrawList();
+    }
+}
+
+void HierarchyCallStack::UpdateFlameOffsets() const {
+    // children start at the left edge of their parent, the cursor of the next level is reset to
+    // the frame just placed
+    if (mFlameCursor.empty()) {
+        mFlameCursor.assign(1, 0.0);
+    }
+    for (int i = (int)mFlameOffsets.size(); i < mFuncs.size(); i++) {
         int level = mFuncs[i].level;
-        width     = sDrawRectText({p.x + (float)level * 25.f, p.y - width * (float)i},
-                              mFuncs[i].name,
-                              gColorPlate[level % gColorPlate.size()]);
+        if (level >= mFlameCursor.size()) {
+            mFlameCursor.resize(level + 1, mFlameCursor.back());
+        }
+        double offset = mFlameCursor[level];
+        mFlameOffsets.push_back(offset);
+        mFlameCursor[level] += mFuncs[i].weight;
+        mFlameCursor.resize(level + 2);
+        mFlameCursor[level + 1] = offset;
+        if (level == 0) {
+            mFlameTotal += mFuncs[i].weight;
+        }
+    }
+}
+
+Vec2 HierarchyCallStack::FlamePosition(int i, float& width) const {
+    Vec2  startPos = {50, 750};
+    float canvas   = (float)gCamera.mWidth - 2.f * startPos.x;
+    float scale    = mFlameTotal > 0.0 ? canvas / (float)mFlameTotal : 0.f;
+    width          = (float)mFuncs[i].weight * scale;
+    return {startPos.x + (float)mFlameOffsets[i] * scale,
+            startPos.y - sRectTextHeight() * (float)mFuncs[i].level};
+}
+
+Vec2 HierarchyCallStack::ListPosition(int i) const {
+    return {50.f + (float)mFuncs[i].level * 25.f, 750.f - sRectTextHeight() * (float)i};
+}
+
+void HierarchyCallStack::VisibleRows(int& first, int& last) const {
+    // rows go down from y = 750, one sRectTextHeight apart, keep one row of margin on each side
+    float height = sRectTextHeight();
+    float extent = (float)gCamera.mHeight / 2.f * gCamera.mZoom;
+    float top    = gCamera.mCenter.y + extent;
+    float bottom = gCamera.mCenter.y - extent;
+    first = std::max(0, (int)std::floor((750.f - top) / height) - 1);
+    last  = std::min((int)mFuncs.size(), (int)std::ceil((750.f - bottom) / height) + 1);
+    last  = std::max(first, last);
+}
+
+Color4 HierarchyCallStack::FuncColor(int i) const {
+    if (!mMatched.empty() && mMatched[mFuncs[i].name]) {
+        return DarkOrange;
+    }
+    return gColorPlate[mFuncs[i].level % gColorPlate.size()];
+}
+
+void HierarchyCallStack::DrawFlameGraph() const {
+    {
+        PROFILE_SCOPE("Layout");
+        UpdateFlameOffsets();
+    }
+    {
+        PROFILE_SCOPE("BatchBuild");
+        for (int i = 0; i < mFuncs.size(); i++) {
+            float width;
+            Vec2  position = FlamePosition(i, width);
+            // boxes thinner than a pixel are not visible
+            if (width < gCamera.mZoom)
+                continue;
+            sDrawRectTextClipped(position, width, mNames.Get(mFuncs[i].name), FuncColor(i));
+        }
+    }
+    gDraw.Flush();
+}
+
+void HierarchyCallStack::InvalidateGeometry() {
+    mRowBoxes.Clear();
+    mBoxedFuncs = 0;
+    mRowPyramid.Clear();
+    mFlameOffsets.clear();
+    mFlameCursor.clear();
+    mFlameTotal = 0.0;
+}
+
+void HierarchyCallStack::DrawList() const {
+    if (sRectTextHeight() / gCamera.mZoom < 1.f) {
+        DrawListBands();
+        return;
+    }
+    {
+        PROFILE_SCOPE("BatchBuild");
+        // a row only depends on its own line, so rows added since the last frame are all the
+        // layout and upload work there is
+        for (; mBoxedFuncs < (int)mFuncs.size(); mBoxedFuncs++) {
+            int i = mBoxedFuncs;
+            sAddRectTextBox(mRowBoxes, ListPosition(i), mNames.Get(mFuncs[i].name), FuncColor(i));
+        }
+        // text goes through ImGui every frame, skip what is out of view
+        int first, last;
+        VisibleRows(first, last);
+        for (int i = first; i < last; i++) {
+            gDraw.DrawString(ListPosition(i), mNames.Get(mFuncs[i].name), 10, FuncColor(i));
+        }
+    }
+    mRowBoxes.Flush();
+    gDraw.Flush();
+}
+
+void HierarchyCallStack::DrawListBands() const {
+    {
+        PROFILE_SCOPE("Layout");
+        // appended rows only extend the last blocks
+        int plate = (int)gColorPlate.size();
+        mRowPyramid.Update((int)mFuncs.size(), mRowPyramid.RowCount(), [&](int i) {
+            const auto& func = mFuncs[i];
+            return RowPyramid::Row{func.level,
+                                   ListPosition(i).x + 10.f * (float)mNames.Get(func.name).size(),
+                                   (uint16_t)(func.level % plate),
+                                   !mMatched.empty() && mMatched[func.name] != 0};
+        });
+    }
+    {
+        PROFILE_SCOPE("BatchBuild");
+        float height = sRectTextHeight();
+        int   level  = mRowPyramid.LevelFor(height / gCamera.mZoom);
+        int   rows   = RowPyramid::sRowsPerBlock(level);
+        int   first, last;
+        VisibleRows(first, last);
+        const auto& blocks = mRowPyramid.GetLevel(level);
+        int         end    = std::min((int)blocks.size(), (last + rows - 1) / rows);
+        for (int b = first / rows; b < end; b++) {
+            const auto& block = blocks[b];
+            int         lastRow = std::min((int)mFuncs.size(), (b + 1) * rows) - 1;
+            // same extent as the boxes of sRectTextBounds
+            Vec2 lower = {50.f + (float)block.minLevel * 25.f - 5.f,
+                          750.f - height * (float)lastRow - 22.f};
+            Vec2 upper = {block.right, 750.f - height * (float)(b * rows) + 1.f};
+            gDraw.DrawSolidPolygon({lower, {upper.x, lower.y}, upper, {lower.x, upper.y}},
+                                   block.highlight ? DarkOrange : gColorPlate[block.color]);
+        }
     }
     gDraw.Flush();
 }
+
+void HierarchyCallStack::BuildSearchIndex() {
+    PROFILE_SCOPE("SearchIndex");
+    mSearchIndex.Build(mNames);
+    mSearchIndexed = true;
+    mFirstUse.assign(mNames.Size(), -1);
+    mUseCount.assign(mNames.Size(), 0);
+    for (int i = (int)mFuncs.size() - 1; i >= 0; i--) {
+        mFirstUse[mFuncs[i].name] = i;
+        mUseCount[mFuncs[i].name]++;
+    }
+    mMatched.clear();
+    mQuery.clear();
+    mSearchResult = SearchResult();
+    InvalidateGeometry();
+}
+
+void HierarchyCallStack::UpdateSearch(int firstFunc, uint32_t firstName) {
+    // nothing to extend before the first BuildSearchIndex
+    if (!mSearchIndexed)
+        return;
+    if (mSearchIndex.NeedsRebuild(mNames)) {
+        PROFILE_SCOPE("SearchIndex");
+        mSearchIndex.Build(mNames);
+    }
+    mFirstUse.resize(mNames.Size(), -1);
+    mUseCount.resize(mNames.Size(), 0);
+    for (int i = firstFunc; i < (int)mFuncs.size(); i++) {
+        if (mFirstUse[mFuncs[i].name] < 0) {
+            mFirstUse[mFuncs[i].name] = i;
+        }
+        mUseCount[mFuncs[i].name]++;
+    }
+    if (mQuery.empty())
+        return;
+
+    // only the new names need testing, old ones keep their match state
+    auto names = mQueryRegex ? mSearchIndex.FindRegexPrefix(mNames, mQuery, firstName)
+                             : mSearchIndex.FindSubstring(mNames, mQuery, firstName);
+    mMatched.resize(mNames.Size(), 0);
+    for (uint32_t name : names) {
+        mMatched[name] = 1;
+    }
+    mSearchResult.names += (int)names.size();
+    for (int i = firstFunc; i < (int)mFuncs.size(); i++) {
+        if (mMatched[mFuncs[i].name]) {
+            mSearchResult.hits++;
+            if (mSearchResult.first < 0) {
+                mSearchResult.first = i;
+            }
+        }
+    }
+}
+
+SearchResult HierarchyCallStack::Search(const std::string& query, bool regexPrefix) {
+    SearchResult result;
+    mMatched.clear();
+    mQuery        = query;
+    mQueryRegex   = regexPrefix;
+    mSearchResult = result;
+    // highlight colors are baked into the retained boxes
+    InvalidateGeometry();
+    if (query.empty())
+        return result;
+
+    auto start = std::chrono::steady_clock::now();
+    auto names = regexPrefix ? mSearchIndex.FindRegexPrefix(mNames, query)
+                             : mSearchIndex.FindSubstring(mNames, query);
+    mMatched.assign(mNames.Size(), 0);
+    for (uint32_t name : names) {
+        mMatched[name] = 1;
+        result.hits += mUseCount[name];
+        if (mFirstUse[name] >= 0 && (result.first < 0 || mFirstUse[name] < result.first)) {
+            result.first = mFirstUse[name];
+        }
+    }
+    result.names = (int)names.size();
+    result.milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    mSearchResult = result;
+    return result;
+}
+
+int HierarchyCallStack::NextHit(int after) const {
+    if (mMatched.empty())
+        return -1;
+    int n = (int)mFuncs.size();
+    for (int k = 1; k <= n; k++) {
+        int i = (after + k) % n;
+        if (mMatched[mFuncs[i].name])
+            return i;
+    }
+    return -1;
+}
+
+void HierarchyCallStack::Focus(int func, CallStackLayout layout) const {
+    if (func < 0 || func >= mFuncs.size())
+        return;
+    // only the one row is placed: list rows never move, flame boxes come from the retained offsets
+    Vec2  p;
+    float width;
+    if (layout == CallStackLayout::FlameGraph) {
+        UpdateFlameOffsets();
+        p = FlamePosition(func, width);
+    } else {
+        p     = ListPosition(func);
+        width = 10.f * (float)mNames.Get(mFuncs[func].name).size();
+    }
+
+    // center the row vertically, scroll sideways only if the box is out of view
+    float extent = (float)gCamera.mWidth / 2.f * gCamera.mZoom;
+    gCamera.mCenter.y = p.y - sRectTextHeight() / 2.f;
+    if (p.x < gCamera.mCenter.x - extent || p.x + width > gCamera.mCenter.x + extent) {
+        gCamera.mCenter.x = p.x - 50.f + extent;
+    }
+}
 #endif   // CODEGRAPH_HIERARCHYCALLSTACK_H
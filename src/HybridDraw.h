@@ -33,10 +33,32 @@
 #define Blue6    Vec4(241, 239, 236, 255) / 255.f
 
 
-static float sDrawRectText(const Vec2& p, const std::string& text, const Color4& color = DarkRed,
+static float sRectTextHeight(int fontSize = 10) {
+    return 2.3f * (float)fontSize;
+}
+
+/// box drawn around text that starts at p
+static void sRectTextBounds(const Vec2& p, std::string_view text, int fontSize, Vec2& lower,
+                            Vec2& upper) {
+    lower = {p.x - 5, p.y - 2.2 * (float)fontSize};
+    upper = {p.x + (float)fontSize * (float)text.size() * 1, p.y + (float)fontSize * 0.1};
+}
+
+/// the box of sDrawRectText, appended to a retained buffer instead of this frame's batch
+static void sAddRectTextBox(LineBuffer& buffer, const Vec2& p, std::string_view text,
+                            const Color4& color = DarkRed, int fontSize = 10) {
+    Vec2 lower, upper;
+    sRectTextBounds(p, text, fontSize, lower, upper);
+    buffer.AddLine(lower, {upper.x, lower.y}, color);
+    buffer.AddLine({upper.x, lower.y}, upper, color);
+    buffer.AddLine(upper, {lower.x, upper.y}, color);
+    buffer.AddLine({lower.x, upper.y}, lower, color);
+}
+
+static float sDrawRectText(const Vec2& p, std::string_view text, const Color4& color = DarkRed,
                            int fontSize = 10) {
-    Vec2 lower = {p.x - 5, p.y - 2.2 * (float)fontSize};
-    Vec2 upper = {p.x + (float)fontSize * (float)text.size() * 1, p.y + (float)fontSize * 0.1};
+    Vec2 lower, upper;
+    sRectTextBounds(p, text, fontSize, lower, upper);
     static int flag = 0;
     if (!flag) {
         spdlog::debug("{} {} {} {}", lower.x, lower.y, upper.x, upper.y);
@@ -51,5 +73,20 @@ static float sDrawRectText(const Vec2& p, const std::string& text, const Color4&
     return upper.y - lower.y;
 }
 
+/// box of a given width, the text is cut to what fits inside
+static void sDrawRectTextClipped(const Vec2& p, float width, std::string_view text,
+                                 const Color4& color = DarkRed, int fontSize = 10) {
+    Vec2 lower = {p.x, p.y - 2.2f * (float)fontSize};
+    Vec2 upper = {p.x + width, p.y + (float)fontSize * 0.1f};
+    gDraw.DrawPolygon({lower, {upper.x, lower.y}, upper, {lower.x, upper.y}}, color);
+
+    // same budget as sDrawRectText: fontSize world units per character
+    auto chars = (size_t)(width / (float)fontSize);
+    if (chars >= text.size()) {
+        gDraw.DrawString(p, text, fontSize, color);
+    } else if (chars > 2) {
+        gDraw.DrawString(p, std::string(text.substr(0, chars - 2)) + "..", fontSize, color);
+    }
+}
 
 #endif   // CODEGRAPH_HYBRIDDRAW_H
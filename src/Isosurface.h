@@ -0,0 +1,415 @@
+//
+// Created by ChenhuiWang on 2024/5/30.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_ISOSURFACE_H
+#define CODEGRAPH_ISOSURFACE_H
+
+#include "PassReport.h"
+#include "SparseBlockGrid.h"
+#include "ThreadPool.h"
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+struct SurfaceParams {
+    double spacing = 0.0;   // distance between samples, 0 takes h / 2
+    double iso     = 0.5;   // level of the surface, a fraction of the mean density at the particles
+
+    bool operator==(const SurfaceParams& other) const {
+        return spacing == other.spacing && iso == other.iso;
+    }
+
+    bool operator!=(const SurfaceParams& other) const { return !(*this == other); }
+};
+
+template<int Dim> class Isosurface {
+    /// Fluid surface from anisotropic kernels. Splat samples the density
+    /// phi(x) = sum_j det(G_j) W(|G_j (x - c_j)|), W(q) = (1 - q^2 / 4)^3 for q < 2, normalized to
+    /// integrate to one, into a SparseBlockGrid: only blocks some kernel reaches are allocated.
+    /// Extract runs marching squares in 2D and marching tetrahedra in 3D, six tetrahedra per cube,
+    /// at iso times the mean density at the particles. Every pass runs on gThreadPool over blocks
+    /// and writes its own block only, so the output does not depend on the thread count.
+public:
+    using Vec  = Eigen::Matrix<double, Dim, 1>;
+    using Mat  = Eigen::Matrix<double, Dim, Dim>;
+    using Grid = SparseBlockGrid<Dim>;
+    using Cell = typename Grid::Cell;
+
+    void Splat(const std::vector<Vec>& centers, const std::vector<Mat>& kernels, double spacing) {
+        int n = (int)centers.size();
+        mGrid.Reset(spacing);
+
+        // sample box of every kernel, padded by one sample below so every cell with a corner
+        // inside a kernel has its first corner in an allocated block
+        PassReport        boundsReport("surface blocks", n);
+        std::vector<Cell> lower(n), upper(n);
+        mWeights.resize(n);
+        ParallelFor(0, n, sParticleGrain, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                Mat inverse = kernels[i].inverse();
+                for (int d = 0; d < Dim; d++) {
+                    double extent = 2.0 * inverse.row(d).norm();
+                    lower[i][d]   = (int)std::floor((centers[i][d] - extent) / spacing) - 1;
+                    upper[i][d]   = (int)std::ceil((centers[i][d] + extent) / spacing);
+                }
+                mWeights[i] = kernels[i].determinant() / sKernelIntegral;
+            }
+        });
+        // particles of every block in CSR form, in particle order so sums are deterministic
+        std::vector<std::pair<int, int>> pairs;   // (block, particle)
+        for (int i = 0; i < n; i++) {
+            Cell first = Grid::sBlockOf(lower[i]);
+            Cell last  = Grid::sBlockOf(upper[i]);
+            sForEachCell(
+                first, last, [&](const Cell& block) { pairs.emplace_back(mGrid.Touch(block), i); });
+        }
+        int blocks = mGrid.BlockCount();
+        mBlockStart.assign(blocks + 1, 0);
+        for (const auto& pair : pairs) {
+            mBlockStart[pair.first + 1]++;
+        }
+        for (int b = 0; b < blocks; b++) {
+            mBlockStart[b + 1] += mBlockStart[b];
+        }
+        mBlockParticles.resize(pairs.size());
+        std::vector<int> cursor(mBlockStart.begin(), mBlockStart.end() - 1);
+        for (const auto& [b, i] : pairs) {
+            mBlockParticles[cursor[b]++] = i;
+        }
+        pairs = {};
+        boundsReport.AddCount("blocks", blocks);
+        boundsReport.AddCount("block particle pairs", (long long)mBlockParticles.size());
+        boundsReport.AddCount("MB", (long long)(mGrid.MemoryBytes() >> 20));
+        Finish(boundsReport);
+
+        PassReport splatReport("splat", blocks);
+        ParallelFor(0, blocks, 1, [&](int begin, int end) {
+            for (int b = begin; b < end; b++) {
+                float* values = mGrid.Block(b);
+                Cell   first, last;
+                for (int d = 0; d < Dim; d++) {
+                    first[d] = mGrid.BlockOrigin(b)[d] * Grid::sBlockSize;
+                    last[d]  = first[d] + Grid::sBlockSize - 1;
+                }
+                for (int k = mBlockStart[b]; k < mBlockStart[b + 1]; k++) {
+                    int  i = mBlockParticles[k];
+                    Cell from, to;
+                    for (int d = 0; d < Dim; d++) {
+                        from[d] = std::max(first[d], lower[i][d]);
+                        to[d]   = std::min(last[d], upper[i][d]);
+                    }
+                    // rows along x, where q = G (x - c) advances by a constant step
+                    const Mat& G    = kernels[i];
+                    Vec        step = spacing * G.col(0);
+                    Cell       rows = to;
+                    rows[0]         = from[0];
+                    sForEachCell(from, rows, [&](const Cell& sample) {
+                        Vec  q = G * (mGrid.Position(sample) - centers[i]);
+                        Cell local;
+                        for (int d = 0; d < Dim; d++) {
+                            local[d] = sample[d] - first[d];
+                        }
+                        // only the part of the row inside the support, |q + x step| < 2
+                        double a    = step.squaredNorm();
+                        double b    = q.dot(step);
+                        double disc = b * b - a * (q.squaredNorm() - 4.0);
+                        if (!(disc > 0.0))
+                            return;
+                        double root  = std::sqrt(disc);
+                        int    begin = std::max(0, (int)std::ceil((-b - root) / a));
+                        int    end   = std::min(to[0] - from[0], (int)std::floor((-b + root) / a));
+                        float* row   = values + Grid::sLocalIndex(local);
+                        q += begin * step;
+                        for (int x = begin; x <= end; x++, q += step) {
+                            double q2 = 0.25 * q.squaredNorm();
+                            if (q2 < 1.0) {
+                                double w = 1.0 - q2;
+                                row[x] += (float)(mWeights[i] * w * w * w);
+                            }
+                        }
+                    });
+                }
+            }
+        });
+        Finish(splatReport);
+
+        // the level is relative to the density the particles see, whatever their spacing
+        int                 chunks = ThreadPool::sChunkCount(0, n, sParticleGrain);
+        std::vector<double> chunkSums(chunks, 0.0);
+        ParallelFor(0, n, sParticleGrain, [&](int begin, int end) {
+            double sum = 0.0;
+            for (int i = begin; i < end; i++) {
+                Cell nearest;
+                for (int d = 0; d < Dim; d++) {
+                    nearest[d] = (int)std::lround(centers[i][d] / spacing);
+                }
+                sum += mGrid.Sample(nearest);
+            }
+            chunkSums[begin / sParticleGrain] = sum;
+        });
+        double sum = 0.0;
+        for (double chunkSum : chunkSums) {
+            sum += chunkSum;
+        }
+        mReference = n > 0 ? sum / n : 0.0;
+    }
+
+    /// the surface where phi = iso * Reference(): segments in 2D, two vertices each, and
+    /// triangles in 3D, three vertices each with the normal pointing out of the fluid
+    void Extract(double iso) {
+        float level  = (float)(iso * mReference);
+        int   blocks = mGrid.BlockCount();
+        int   chunks = ThreadPool::sChunkCount(0, blocks, sBlockGrain);
+        std::vector<std::vector<Vec>> chunkVertices(chunks);
+        PassReport marchReport(Dim == 2 ? "marching squares" : "marching tetrahedra", blocks);
+        ParallelFor(0, blocks, sBlockGrain, [&](int begin, int end) {
+            auto& vertices = chunkVertices[begin / sBlockGrain];
+            for (int b = begin; b < end; b++) {
+                MarchBlock(b, level, vertices);
+            }
+        });
+        size_t count = 0;
+        for (const auto& vertices : chunkVertices) {
+            count += vertices.size();
+        }
+        mVertices.clear();
+        mVertices.reserve(count);
+        for (auto& vertices : chunkVertices) {
+            mVertices.insert(mVertices.end(), vertices.begin(), vertices.end());
+            vertices = {};
+        }
+        marchReport.AddCount(Dim == 2 ? "segments" : "triangles", (long long)(count / Dim));
+        Finish(marchReport);
+    }
+
+    /// segments (2D) or triangles (3D) of the last Extract, as consecutive vertices
+    const std::vector<Vec>& Vertices() const { return mVertices; }
+
+    /// mean density at the particles, the unit of iso
+    double Reference() const { return mReference; }
+
+    const Grid& Samples() const { return mGrid; }
+
+    /// log a PassReport per pass, on by default
+    void SetLogPasses(bool logPasses) { mLogPasses = logPasses; }
+
+private:
+    static constexpr int sParticleGrain = 256;
+    static constexpr int sBlockGrain    = 4;
+    static constexpr int sCorners       = 1 << Dim;
+
+    /// integral of W(|q|) over the plane or space
+    static constexpr double sKernelIntegral =
+        Dim == 2 ? 3.14159265358979323846 : 512.0 * 3.14159265358979323846 / 315.0;
+
+    /// fn(cell) for every cell in the box [first, last], x fastest
+    template<typename Fn> static void sForEachCell(const Cell& first, const Cell& last, const Fn& fn) {
+        for (int d = 0; d < Dim; d++) {
+            if (last[d] < first[d])
+                return;
+        }
+        Cell cell = first;
+        while (true) {
+            fn(cell);
+            int d = 0;
+            for (; d < Dim; d++) {
+                if (++cell[d] <= last[d])
+                    break;
+                cell[d] = first[d];
+            }
+            if (d == Dim)
+                return;
+        }
+    }
+
+    /// the cells whose first corner lies in block b. Corners past the block's upper faces are read
+    /// from the neighbor blocks, found once per block.
+    void MarchBlock(int b, float level, std::vector<Vec>& vertices) const {
+        const Cell& origin = mGrid.BlockOrigin(b);
+        const float* neighbors[sCorners];
+        for (int c = 0; c < sCorners; c++) {
+            Cell block = origin;
+            for (int d = 0; d < Dim; d++) {
+                block[d] += (c >> d) & 1;
+            }
+            int index    = c == 0 ? b : mGrid.Find(block);
+            neighbors[c] = index < 0 ? nullptr : mGrid.Block(index);
+        }
+
+        Cell first, last;
+        for (int d = 0; d < Dim; d++) {
+            first[d] = 0;
+            last[d]  = Grid::sBlockSize - 1;
+        }
+        sForEachCell(first, last, [&](const Cell& local) {
+            float values[sCorners];
+            bool  above = false, below = false;
+            for (int c = 0; c < sCorners; c++) {
+                Cell corner;
+                int  block = 0;
+                for (int d = 0; d < Dim; d++) {
+                    corner[d] = local[d] + ((c >> d) & 1);
+                    if (corner[d] == Grid::sBlockSize) {
+                        corner[d] = 0;
+                        block |= 1 << d;
+                    }
+                }
+                values[c] = neighbors[block] ? neighbors[block][Grid::sLocalIndex(corner)] : 0.f;
+                above     = above || values[c] >= level;
+                below     = below || values[c] < level;
+            }
+            if (!(above && below))
+                return;
+            Cell sample;
+            for (int d = 0; d < Dim; d++) {
+                sample[d] = origin[d] * Grid::sBlockSize + local[d];
+            }
+            if constexpr (Dim == 2) {
+                MarchSquare(sample, values, level, vertices);
+            } else {
+                static_assert(Dim == 3, "2D or 3D only");
+                MarchCube(sample, values, level, vertices);
+            }
+        });
+    }
+
+    /// corner c of the cell with first corner sample, bit d of c is the offset along axis d.
+    /// Taken from the sample coordinates so every cell sharing the corner gets the same position.
+    Vec Corner(const Cell& sample, int c) const {
+        Cell corner = sample;
+        for (int d = 0; d < Dim; d++) {
+            corner[d] += (c >> d) & 1;
+        }
+        return mGrid.Position(corner);
+    }
+
+    /// crossing on the edge between corners a < b, always interpolated from a to b so that the
+    /// cells sharing the edge compute the same point
+    Vec Crossing(const Cell& sample, const float* values, float level, int a, int b) const {
+        if (a > b) {
+            std::swap(a, b);
+        }
+        double t = (double)(level - values[a]) / (double)(values[b] - values[a]);
+        Vec    p = Corner(sample, a);
+        return p + t * (Corner(sample, b) - p);
+    }
+
+    /// corners 0 (0, 0), 1 (1, 0), 2 (0, 1), 3 (1, 1). The saddles take the side of the average
+    /// of the four corners.
+    void MarchSquare(const Cell& sample, const float* values, float level,
+                     std::vector<Vec>& vertices) const {
+        // edges between corners, around the square
+        static const int sEdges[4][2] = {{0, 1}, {1, 3}, {2, 3}, {0, 2}};
+        // edge pairs per case, cases are bit masks of the corners at or above the level in the
+        // order 0, 1, 3, 2 around the square
+        static const int sSegments[16][4] = {{-1, -1, -1, -1},
+                                             {3, 0, -1, -1},
+                                             {0, 1, -1, -1},
+                                             {3, 1, -1, -1},
+                                             {1, 2, -1, -1},
+                                             {3, 0, 1, 2},   // saddle, center below
+                                             {0, 2, -1, -1},
+                                             {3, 2, -1, -1},
+                                             {2, 3, -1, -1},
+                                             {0, 2, -1, -1},
+                                             {0, 1, 2, 3},   // saddle, center below
+                                             {1, 2, -1, -1},
+                                             {1, 3, -1, -1},
+                                             {0, 1, -1, -1},
+                                             {3, 0, -1, -1},
+                                             {-1, -1, -1, -1}};
+        int around[4] = {0, 1, 3, 2};
+        int index     = 0;
+        for (int k = 0; k < 4; k++) {
+            index |= (values[around[k]] >= level) << k;
+        }
+        int segments[4];
+        std::copy(sSegments[index], sSegments[index] + 4, segments);
+        float center = 0.25f * (values[0] + values[1] + values[2] + values[3]);
+        if ((index == 5 || index == 10) && center >= level) {
+            // the corners above connect through the center, cut off the ones below
+            int flipped[2][4] = {{0, 1, 2, 3}, {3, 0, 1, 2}};
+            std::copy(flipped[index == 10], flipped[index == 10] + 4, segments);
+        }
+        for (int k = 0; k < 4 && segments[k] >= 0; k++) {
+            const int* edge = sEdges[segments[k]];
+            vertices.push_back(Crossing(sample, values, level, edge[0], edge[1]));
+        }
+    }
+
+    /// the cube cut into the six tetrahedra around its diagonal 0-7, the same cut in every cube
+    /// so neighboring cubes agree on their shared faces
+    void MarchCube(const Cell& sample, const float* values, float level,
+                   std::vector<Vec>& vertices) const {
+        static const int sTetrahedra[6][4] = {
+            {0, 1, 3, 7}, {0, 2, 3, 7}, {0, 2, 6, 7}, {0, 4, 6, 7}, {0, 4, 5, 7}, {0, 1, 5, 7}};
+        for (const auto& tetrahedron : sTetrahedra) {
+            int inside[4], outside[4];
+            int insideCount = 0, outsideCount = 0;
+            for (int c : tetrahedron) {
+                if (values[c] >= level) {
+                    inside[insideCount++] = c;
+                } else {
+                    outside[outsideCount++] = c;
+                }
+            }
+            if (insideCount == 0 || outsideCount == 0)
+                continue;
+            // the triangles face from the inside corners to the outside ones
+            Vec direction = Vec::Zero();
+            for (int k = 0; k < outsideCount; k++) {
+                direction += Corner(sample, outside[k]) / outsideCount;
+            }
+            for (int k = 0; k < insideCount; k++) {
+                direction -= Corner(sample, inside[k]) / insideCount;
+            }
+            if (insideCount == 2) {
+                Vec quad[4] = {Crossing(sample, values, level, inside[0], outside[0]),
+                               Crossing(sample, values, level, inside[0], outside[1]),
+                               Crossing(sample, values, level, inside[1], outside[1]),
+                               Crossing(sample, values, level, inside[1], outside[0])};
+                AddTriangle(quad[0], quad[1], quad[2], direction, vertices);
+                AddTriangle(quad[0], quad[2], quad[3], direction, vertices);
+            } else {
+                // one corner on its own side
+                int        lone   = insideCount == 1 ? inside[0] : outside[0];
+                const int* others = insideCount == 1 ? outside : inside;
+                AddTriangle(Crossing(sample, values, level, lone, others[0]),
+                            Crossing(sample, values, level, lone, others[1]),
+                            Crossing(sample, values, level, lone, others[2]),
+                            direction,
+                            vertices);
+            }
+        }
+    }
+
+    static void AddTriangle(const Vec& a, const Vec& b, const Vec& c, const Vec& direction,
+                            std::vector<Vec>& vertices) {
+        bool flip = (b - a).cross(c - a).dot(direction) < 0.0;
+        vertices.push_back(a);
+        vertices.push_back(flip ? c : b);
+        vertices.push_back(flip ? b : c);
+    }
+
+    void Finish(PassReport& report) const {
+        report.Stop();
+        if (mLogPasses) {
+            report.Log();
+        }
+    }
+
+    bool                mLogPasses = true;
+    Grid                mGrid;
+    std::vector<double> mWeights;          // det(G) over the kernel integral, per particle
+    std::vector<int>    mBlockStart;       // CSR offsets into mBlockParticles, one per block
+    std::vector<int>    mBlockParticles;   // particles whose kernel reaches the block
+    double              mReference = 0.0;
+    std::vector<Vec>    mVertices;
+};
+
+#endif   // CODEGRAPH_ISOSURFACE_H
@@ -0,0 +1,32 @@
+//
+// Created by ChenhuiWang on 2024/6/2.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_KAHANSUM_H
+#define CODEGRAPH_KAHANSUM_H
+
+template<typename T> class KahanSum {
+    /// Compensated summation: the low-order part lost by every addition is kept in a correction
+    /// term and subtracted from the next summand, so the error does not grow with the number of
+    /// terms. T is a double or a fixed size Eigen vector or matrix, summed entry by entry.
+    /// Only correct without -ffast-math, which would fold the correction away.
+public:
+    explicit KahanSum(const T& zero) : mSum(zero), mCompensation(zero) {}
+
+    void Add(const T& x) {
+        T y           = x - mCompensation;
+        T t           = mSum + y;
+        mCompensation = (t - mSum) - y;
+        mSum          = t;
+    }
+
+    const T& Sum() const { return mSum; }
+
+private:
+    T mSum;
+    T mCompensation;
+};
+
+#endif   // CODEGRAPH_KAHANSUM_H
@@ -0,0 +1,131 @@
+//
+// Created by ChenhuiWang on 2024/5/27.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_MORTONORDER_H
+#define CODEGRAPH_MORTONORDER_H
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+template<int Dim> class MortonOrder {
+    /// Order of points along the Z curve: the bounding box is quantized to 2^(64 / Dim) steps per
+    /// axis, the bits of the coordinates are interleaved into one 64 bit code and the codes radix
+    /// sorted. Points close in space end up close in the order, so loops over neighbors that run
+    /// in this order keep hitting the same cache lines.
+    /// Order()[k] is the original index of the k-th point, Gather and Scatter convert arrays.
+public:
+    using Vec = Eigen::Matrix<double, Dim, 1>;
+
+    void Build(const std::vector<Vec>& points) {
+        // Eigen's fixed size vectors are packed, coordinate d of point i is at data[i * Dim + d]
+        const double* axes[Dim];
+        for (int d = 0; d < Dim; d++) {
+            axes[d] = points.empty() ? nullptr : points[0].data() + d;
+        }
+        Build((int)points.size(), axes, Dim);
+    }
+
+    /// n points with coordinate d of point i at axes[d][i * stride], stride 1 for arrays per axis
+    template<typename Real> void Build(int n, const Real* const axes[Dim], int stride) {
+        mOrder.resize(n);
+        if (n == 0)
+            return;
+        // one pass per axis, for arrays per axis these loops are plain streams
+        std::vector<uint64_t> codes(n, 0);
+        const double          steps = (double)((1ull << sBits) - 1);
+        for (int d = 0; d < Dim; d++) {
+            const Real* axis  = axes[d];
+            double      lower = (double)axis[0], upper = lower;
+            for (int i = 0; i < n; i++) {
+                lower = std::min(lower, (double)axis[(size_t)i * stride]);
+                upper = std::max(upper, (double)axis[(size_t)i * stride]);
+            }
+            double scale = upper > lower ? steps / (upper - lower) : 0.0;
+            for (int i = 0; i < n; i++) {
+                auto q = (uint64_t)(((double)axis[(size_t)i * stride] - lower) * scale);
+                codes[i] |= sSpread(q) << d;
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            mOrder[i] = i;
+        }
+        sRadixSort(codes, mOrder);
+    }
+
+    const std::vector<int>& Order() const { return mOrder; }
+
+    /// out[k] = in[Order()[k]], from the original order into Z order
+    template<typename T> void Gather(const std::vector<T>& in, std::vector<T>& out) const {
+        out.resize(mOrder.size());
+        for (size_t k = 0; k < mOrder.size(); k++) {
+            out[k] = in[mOrder[k]];
+        }
+    }
+
+    /// out[Order()[k]] = in[k], back from Z order into the original one
+    template<typename T> void Scatter(const std::vector<T>& in, std::vector<T>& out) const {
+        out.resize(mOrder.size());
+        for (size_t k = 0; k < mOrder.size(); k++) {
+            out[mOrder[k]] = in[k];
+        }
+    }
+
+private:
+    static constexpr int sBits = 64 / Dim;   // per axis, 32 in 2D and 21 in 3D
+
+    /// bits of q moved Dim apart: bit b goes to bit Dim * b
+    static uint64_t sSpread(uint64_t q) {
+        if constexpr (Dim == 2) {
+            q &= 0xffffffffull;
+            q = (q | q << 16) & 0x0000ffff0000ffffull;
+            q = (q | q << 8) & 0x00ff00ff00ff00ffull;
+            q = (q | q << 4) & 0x0f0f0f0f0f0f0f0full;
+            q = (q | q << 2) & 0x3333333333333333ull;
+            q = (q | q << 1) & 0x5555555555555555ull;
+        } else {
+            static_assert(Dim == 3, "2D or 3D only");
+            q &= 0x1fffffull;
+            q = (q | q << 32) & 0x001f00000000ffffull;
+            q = (q | q << 16) & 0x001f0000ff0000ffull;
+            q = (q | q << 8) & 0x100f00f00f00f00full;
+            q = (q | q << 4) & 0x10c30c30c30c30c3ull;
+            q = (q | q << 2) & 0x1249249249249249ull;
+        }
+        return q;
+    }
+
+    /// LSD radix sort of (code, index) by code, a byte per pass. Passes where all codes share the
+    /// byte are skipped, the sort is stable.
+    static void sRadixSort(std::vector<uint64_t>& codes, std::vector<int>& indices) {
+        size_t                n = codes.size();
+        std::vector<uint64_t> codesTmp(n);
+        std::vector<int>      indicesTmp(n);
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t count[257] = {};
+            for (uint64_t code : codes) {
+                count[((code >> shift) & 0xff) + 1]++;
+            }
+            if (*std::max_element(count + 1, count + 257) == n)
+                continue;
+            for (int b = 0; b < 256; b++) {
+                count[b + 1] += count[b];
+            }
+            for (size_t i = 0; i < n; i++) {
+                size_t k      = count[(codes[i] >> shift) & 0xff]++;
+                codesTmp[k]   = codes[i];
+                indicesTmp[k] = indices[i];
+            }
+            codes.swap(codesTmp);
+            indices.swap(indicesTmp);
+        }
+    }
+
+    std::vector<int> mOrder;
+};
+
+#endif   // CODEGRAPH_MORTONORDER_H
@@ -0,0 +1,216 @@
+//
+// Created by ChenhuiWang on 2024/5/21.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_NEIGHBORLIST_H
+#define CODEGRAPH_NEIGHBORLIST_H
+
+#include "ParticleArrays.h"
+#include "SpatialGrid.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class NeighborList {
+    /// Neighbors of every particle in CSR form, with the kernel weight stored next to each index:
+    /// the neighbors of i are [Begin(i), End(i)). The grid is queried and every weight evaluated
+    /// once, later passes only stream through these arrays. Built in parallel on gThreadPool.
+public:
+    /// kernel(distance) -> weight, neighbors are the points closer than radius
+    template<int Dim, typename Kernel>
+    void Build(const SpatialGrid<Dim>&                            grid,
+               const std::vector<typename SpatialGrid<Dim>::Vec>& points,
+               double                                             radius,
+               const Kernel&                                      kernel) {
+        Gather((int)points.size(), [&](int i, std::vector<int>& indices, std::vector<double>& weights) {
+            grid.ForEachNeighbor(points[i], radius, [&](int j, double d) {
+                indices.push_back(j);
+                weights.push_back(kernel(d));
+            });
+        });
+    }
+
+    /// the same without weights, e.g. the candidates of a VerletList. Weight is not available.
+    template<int Dim>
+    void Build(const SpatialGrid<Dim>&                            grid,
+               const std::vector<typename SpatialGrid<Dim>::Vec>& points,
+               double                                             radius) {
+        Gather((int)points.size(), [&](int i, std::vector<int>& indices, std::vector<double>&) {
+            grid.ForEachNeighbor(points[i], radius, [&](int j, double) { indices.push_back(j); });
+        });
+    }
+
+    /// neighbors are the particle itself and its k nearest other points closer than maxRadius,
+    /// nearest first. The support radius of a particle is the distance to the k-th other point,
+    /// at least minRadius so that coincident points keep a finite kernel. A particle with fewer
+    /// than k points within maxRadius gets fallbackRadius and the neighbors inside it instead.
+    /// Radii are stored in radii. kernel(distance, radius) -> weight
+    template<int Dim, typename Kernel>
+    void BuildNearest(const SpatialGrid<Dim>&                            grid,
+                      const std::vector<typename SpatialGrid<Dim>::Vec>& points,
+                      int                                                k,
+                      double                                             minRadius,
+                      double                                             maxRadius,
+                      double                                             fallbackRadius,
+                      const Kernel&                                      kernel,
+                      std::vector<double>&                               radii) {
+        radii.resize(points.size());
+        Gather((int)points.size(), [&](int i, std::vector<int>& indices, std::vector<double>& weights) {
+            // one scratch heap per worker, the particle itself is one of the k + 1 nearest
+            thread_local std::vector<std::pair<double, int>> nearest;
+            grid.FindNearest(points[i], k + 1, maxRadius, nearest);
+            double radius = (int)nearest.size() == k + 1
+                                ? std::max(nearest.back().first, minRadius)
+                                : fallbackRadius;
+            radii[i]      = radius;
+            for (const auto& [d, j] : nearest) {
+                if (d > radius)
+                    break;
+                indices.push_back(j);
+                weights.push_back(kernel(d, radius));
+            }
+        });
+    }
+
+    /// the candidates closer than radius, e.g. from a VerletList, with the points read per axis.
+    /// kernel(distance) -> weight.
+    /// Lists are counted first and then written in place, the candidates are read twice but
+    /// nothing is gathered and copied.
+    template<typename Real, int Dim, typename Kernel>
+    void Filter(const NeighborList&              candidates,
+                const ParticleArrays<Real, Dim>& points,
+                double                           radius,
+                const Kernel&                    kernel) {
+        int    n       = points.Size();
+        double radius2 = radius * radius;
+        mOffsets.assign(n + 1, 0);
+        ParallelFor(0, n, sGrain, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                int count = 0;
+                for (int k = candidates.Begin(i); k < candidates.End(i); k++) {
+                    count += points.Offset(i, candidates.Index(k)).squaredNorm() < radius2;
+                }
+                mOffsets[i + 1] = count;
+            }
+        });
+        for (int i = 0; i < n; i++) {
+            mOffsets[i + 1] += mOffsets[i];
+        }
+        mIndices.resize(mOffsets[n]);
+        mWeights.resize(mOffsets[n]);
+        ParallelFor(0, n, sGrain, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                int out = mOffsets[i];
+                for (int k = candidates.Begin(i); k < candidates.End(i); k++) {
+                    int    j  = candidates.Index(k);
+                    double d2 = points.Offset(i, j).squaredNorm();
+                    if (d2 < radius2) {
+                        mIndices[out] = j;
+                        mWeights[out] = kernel(std::sqrt(d2));
+                        out++;
+                    }
+                }
+            }
+        });
+    }
+
+    /// sort every list by keys[index], weights move along. With keys that do not depend on the
+    /// order of the points, e.g. unique particle ids, the lists come out in the same order however
+    /// the points were ordered and searched.
+    void SortBy(const std::vector<int>& keys) {
+        bool weighted = !mWeights.empty();
+        ParallelFor(0, Size(), sGrain, [&](int begin, int end) {
+            // one scratch list per worker: the key in the high half, the position in the list in
+            // the low half, so plain integers are sorted and the entries are permuted after
+            thread_local std::vector<uint64_t> order;
+            thread_local std::vector<int>      indices;
+            thread_local std::vector<double>   weights;
+            for (int i = begin; i < end; i++) {
+                int first = Begin(i);
+                int count = Count(i);
+                order.resize(count);
+                for (int k = 0; k < count; k++) {
+                    order[k] = ((uint64_t)(uint32_t)keys[mIndices[first + k]] << 32) | (uint32_t)k;
+                }
+                std::sort(order.begin(), order.end());
+                indices.assign(mIndices.begin() + first, mIndices.begin() + first + count);
+                if (weighted) {
+                    weights.assign(mWeights.begin() + first, mWeights.begin() + first + count);
+                }
+                for (int k = 0; k < count; k++) {
+                    auto from            = (int)(uint32_t)order[k];
+                    mIndices[first + k] = indices[from];
+                    if (weighted) {
+                        mWeights[first + k] = weights[from];
+                    }
+                }
+            }
+        });
+    }
+
+    int Size() const { return (int)mOffsets.size() - 1; }
+
+    int Begin(int i) const { return mOffsets[i]; }
+
+    int End(int i) const { return mOffsets[i + 1]; }
+
+    int Count(int i) const { return mOffsets[i + 1] - mOffsets[i]; }
+
+    /// neighbors of all particles together
+    int PairCount() const { return mOffsets.empty() ? 0 : mOffsets.back(); }
+
+    int Index(int k) const { return mIndices[k]; }
+
+    double Weight(int k) const { return mWeights[k]; }
+
+private:
+    /// query(i, indices, weights) appends the neighbors of i. Chunks gather into their own arrays
+    /// and are concatenated in order, so the lists come out the same as from a serial loop
+    template<typename Query> void Gather(int n, const Query& query) {
+        int chunks = ThreadPool::sChunkCount(0, n, sGrain);
+        std::vector<std::vector<int>>    chunkIndices(chunks);
+        std::vector<std::vector<double>> chunkWeights(chunks);
+        mOffsets.assign(n + 1, 0);
+        ParallelFor(0, n, sGrain, [&](int begin, int end) {
+            auto& indices = chunkIndices[begin / sGrain];
+            auto& weights = chunkWeights[begin / sGrain];
+            for (int i = begin; i < end; i++) {
+                size_t count = indices.size();
+                query(i, indices, weights);
+                mOffsets[i + 1] = (int)(indices.size() - count);
+            }
+        });
+        for (int i = 0; i < n; i++) {
+            mOffsets[i + 1] += mOffsets[i];
+        }
+        bool weighted = false;
+        for (const auto& weights : chunkWeights) {
+            weighted = weighted || !weights.empty();
+        }
+        mIndices.resize(mOffsets[n]);
+        mWeights.resize(weighted ? mOffsets[n] : 0);
+        ParallelFor(0, chunks, 1, [&](int begin, int end) {
+            for (int c = begin; c < end; c++) {
+                int offset = mOffsets[c * sGrain];
+                std::copy(chunkIndices[c].begin(), chunkIndices[c].end(), mIndices.begin() + offset);
+                if (weighted) {
+                    std::copy(
+                        chunkWeights[c].begin(), chunkWeights[c].end(), mWeights.begin() + offset);
+                }
+            }
+        });
+    }
+
+    static constexpr int sGrain = 1024;   // particles per chunk
+
+    std::vector<int>    mOffsets;
+    std::vector<int>    mIndices;
+    std::vector<double> mWeights;
+};
+
+#endif   // CODEGRAPH_NEIGHBORLIST_H
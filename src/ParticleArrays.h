@@ -0,0 +1,153 @@
+//
+// Created by ChenhuiWang on 2024/5/28.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_PARTICLEARRAYS_H
+#define CODEGRAPH_PARTICLEARRAYS_H
+
+#include <partio/src/lib/Partio.h>
+#include <spdlog/spdlog.h>
+#include <Eigen/Dense>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Scalar type of particle positions, double unless built with -DCODEGRAPH_PARTICLE_REAL=float
+#ifndef CODEGRAPH_PARTICLE_REAL
+#define CODEGRAPH_PARTICLE_REAL double
+#endif
+using ParticleReal = CODEGRAPH_PARTICLE_REAL;
+
+template<typename T, size_t Alignment> class AlignedAllocator {
+    /// std::allocator with over-aligned storage, for arrays that SIMD loops read with aligned loads
+public:
+    using value_type = T;
+
+    template<typename U> struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+
+    template<typename U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(Alignment)); }
+
+    template<typename U> bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+
+    template<typename U> bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+/// base pointer and stride in floats of a float attribute with at least count components. Both of
+/// Partio's layouts keep an attribute at a fixed stride, which is taken from the first two
+/// particles. first is null for an empty cache.
+static inline bool sFloatAttribute(const Partio::ParticlesData& data, const char* attribute,
+                                   int count, const float*& first, int& stride) {
+    Partio::ParticleAttribute attr;
+    if (!data.attributeInfo(attribute, attr) ||
+        (attr.type != Partio::VECTOR && attr.type != Partio::FLOAT) || attr.count < count) {
+        spdlog::error("No float{} {} attribute", count, attribute);
+        return false;
+    }
+    int n  = data.numParticles();
+    first  = n > 0 ? data.data<float>(attr, 0) : nullptr;
+    stride = n > 1 ? (int)(data.data<float>(attr, 1) - first) : attr.count;
+    return true;
+}
+
+template<typename Real, int Dim> class ParticleArrays {
+    /// Particle positions as structure of arrays, one array per axis. Every array starts on a cache
+    /// line and is padded with zeros to a whole number of cache lines, so loops over an axis can
+    /// run to PaddedSize() in full SIMD registers without a scalar tail.
+public:
+    using Vec = Eigen::Matrix<double, Dim, 1>;
+
+    static constexpr size_t sAlignment = 64;
+    static constexpr int    sLanes     = (int)(sAlignment / sizeof(Real));
+
+    void Resize(int n) {
+        mSize      = n;
+        int padded = (n + sLanes - 1) / sLanes * sLanes;
+        for (auto& axis : mAxes) {
+            axis.assign(padded, Real(0));
+        }
+    }
+
+    int Size() const { return mSize; }
+
+    int PaddedSize() const { return (int)mAxes[0].size(); }
+
+    Real* Axis(int d) { return mAxes[d].data(); }
+
+    const Real* Axis(int d) const { return mAxes[d].data(); }
+
+    Vec Position(int i) const {
+        Vec p;
+        for (int d = 0; d < Dim; d++) {
+            p[d] = (double)mAxes[d][i];
+        }
+        return p;
+    }
+
+    void SetPosition(int i, const Vec& p) {
+        for (int d = 0; d < Dim; d++) {
+            mAxes[d][i] = (Real)p[d];
+        }
+    }
+
+    /// Position(j) - Position(i), the coordinates are widened before the subtraction
+    Vec Offset(int i, int j) const {
+        Vec y;
+        for (int d = 0; d < Dim; d++) {
+            y[d] = (double)mAxes[d][j] - (double)mAxes[d][i];
+        }
+        return y;
+    }
+
+    /// n points with their first Dim components at data[i * stride + d], e.g. the float3
+    /// positions of a particle cache with stride 3. One pass per axis over the whole buffer.
+    void Load(const float* data, int n, int stride) {
+        Resize(n);
+        for (int d = 0; d < Dim; d++) {
+            Real*        axis = mAxes[d].data();
+            const float* src  = data + d;
+            for (int i = 0; i < n; i++) {
+                axis[i] = (Real)src[(size_t)i * stride];
+            }
+        }
+    }
+
+    /// the first Dim components of a float attribute, read through its base pointer
+    bool Load(const Partio::ParticlesData& data, const char* attribute = "position") {
+        const float* first;
+        int          stride;
+        if (!sFloatAttribute(data, attribute, Dim, first, stride))
+            return false;
+        Load(first, data.numParticles(), stride);
+        return true;
+    }
+
+    /// p = scale * p + offset, per axis
+    void Transform(const Vec& scale, const Vec& offset) {
+        for (int d = 0; d < Dim; d++) {
+            Real* axis = mAxes[d].data();
+            auto  s    = (Real)scale[d];
+            auto  o    = (Real)offset[d];
+            for (int i = 0; i < mSize; i++) {
+                axis[i] = s * axis[i] + o;
+            }
+        }
+    }
+
+private:
+    int                                                    mSize = 0;
+    std::vector<Real, AlignedAllocator<Real, sAlignment>> mAxes[Dim];
+};
+
+#endif   // CODEGRAPH_PARTICLEARRAYS_H
@@ -0,0 +1,129 @@
+//
+// Created by ChenhuiWang on 2024/5/23.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_PASSREPORT_H
+#define CODEGRAPH_PASSREPORT_H
+
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Per-particle logging inside the passes, compiled in only with -DSPH_TRACE_PARTICLES=1.
+// One formatted line per particle and pass costs more than the passes themselves.
+#ifndef SPH_TRACE_PARTICLES
+#define SPH_TRACE_PARTICLES 0
+#endif
+
+#if SPH_TRACE_PARTICLES
+#define SPH_TRACE(...) spdlog::info(__VA_ARGS__)
+#else
+#define SPH_TRACE(...) ((void)0)
+#endif
+
+class Histogram {
+    /// Equal width bins over [lo, hi), values outside the range are counted in the first or last
+    /// bin. Also tracks min, max and mean of everything added.
+public:
+    Histogram(double lo, double hi, int bins)
+        : mLo(lo)
+        , mHi(hi)
+        , mBins(bins, 0) {}
+
+    void Add(double value) {
+        auto bin = (int)((value - mLo) / (mHi - mLo) * (double)mBins.size());
+        mBins[std::clamp(bin, 0, (int)mBins.size() - 1)]++;
+        mMin = std::min(mMin, value);
+        mMax = std::max(mMax, value);
+        mSum += value;
+        mCount++;
+    }
+
+    /// "min 3 mean 41.2 max 97 | [0,10) 12 [10,20) 40 ..."
+    std::string ToString() const {
+        if (mCount == 0)
+            return "empty";
+        std::string str = fmt::format(
+            "min {:.4g} mean {:.4g} max {:.4g} |", mMin, mSum / (double)mCount, mMax);
+        double width = (mHi - mLo) / (double)mBins.size();
+        for (size_t b = 0; b < mBins.size(); b++) {
+            str += fmt::format(" [{:.3g},{:.3g}) {}",
+                               mLo + width * (double)b,
+                               mLo + width * (double)(b + 1),
+                               mBins[b]);
+        }
+        return str;
+    }
+
+private:
+    double           mLo;
+    double           mHi;
+    std::vector<int> mBins;
+    double           mMin   = std::numeric_limits<double>::max();
+    double           mMax   = std::numeric_limits<double>::lowest();
+    double           mSum   = 0.0;
+    long long        mCount = 0;
+};
+
+class PassReport {
+    /// Timing and statistics of one pass over the particles, logged once when the pass is done:
+    /// one line with the time, throughput and counters, then one line per histogram.
+    /// The clock runs from construction to Stop (or Log).
+public:
+    PassReport(std::string name, long long items)
+        : mName(std::move(name))
+        , mItems(items)
+        , mStart(std::chrono::steady_clock::now()) {}
+
+    void Stop() {
+        if (mSeconds < 0.0) {
+            mSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart)
+                           .count();
+        }
+    }
+
+    void AddCount(std::string name, long long value) {
+        mCounts.emplace_back(std::move(name), value);
+    }
+
+    void AddHistogram(std::string name, Histogram histogram) {
+        mHistograms.emplace_back(std::move(name), std::move(histogram));
+    }
+
+    const std::string& Name() const { return mName; }
+
+    double Seconds() const { return mSeconds; }
+
+    void Log() {
+        Stop();
+        std::string counts;
+        for (const auto& [name, value] : mCounts) {
+            counts += fmt::format(", {} {}", name, value);
+        }
+        spdlog::info("[{}] {} items in {:.2f} ms ({:.2f} M/s){}",
+                     mName,
+                     mItems,
+                     1000.0 * mSeconds,
+                     mSeconds > 0.0 ? (double)mItems / mSeconds * 1e-6 : 0.0,
+                     counts);
+        for (const auto& [name, histogram] : mHistograms) {
+            spdlog::info("[{}]   {}: {}", mName, name, histogram.ToString());
+        }
+    }
+
+private:
+    std::string                                    mName;
+    long long                                      mItems;
+    std::chrono::steady_clock::time_point          mStart;
+    double                                         mSeconds = -1.0;
+    std::vector<std::pair<std::string, long long>> mCounts;
+    std::vector<std::pair<std::string, Histogram>> mHistograms;
+};
+
+#endif   // CODEGRAPH_PASSREPORT_H
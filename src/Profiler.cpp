@@ -0,0 +1,220 @@
+//
+// Created by ChenhuiWang on 2024/5/8.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#include "Profiler.h"
+#include <spdlog/spdlog.h>
+#include <imgui/imgui.h>
+#include <algorithm>
+#include <fstream>
+
+Profiler gProfiler;
+
+// keeps a forgotten EndFrame from growing a frame without bound
+static const size_t sMaxEventsPerFrame = 4096;
+
+Profiler::Profiler(int frameCount)
+    : mOrigin(std::chrono::steady_clock::now())
+    , mFrames(frameCount) {}
+
+double Profiler::Now() const {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - mOrigin)
+        .count();
+}
+
+void Profiler::BeginFrame() {
+    auto& frame = CurrentFrame();
+    frame.index = mFrameIndex;
+    frame.begin = Now();
+}
+
+void Profiler::EndFrame() {
+    auto& frame = CurrentFrame();
+    frame.index = mFrameIndex;
+    frame.end   = Now();
+
+    ResolveQueries();
+
+    // Events recorded between EndFrame and the next BeginFrame (e.g. a reload) belong to the next
+    // frame, so the slot is recycled here rather than in BeginFrame
+    mFrameIndex++;
+    auto& next = CurrentFrame();
+    next.index = mFrameIndex;
+    next.begin = next.end = Now();
+    next.events.clear();
+    int slot = (int)(mFrameIndex % (long long)mFrames.size());
+    for (auto& history : mStageHistory) {
+        history[slot] = 0.f;
+    }
+}
+
+int Profiler::StageIndex(const char* name, bool gpu) {
+    std::string key = gpu ? std::string(name) + " (GPU)" : std::string(name);
+    auto        it  = mStageLookup.find(key);
+    if (it != mStageLookup.end())
+        return it->second;
+    int index = (int)mStageNames.size();
+    mStageLookup.emplace(key, index);
+    mStageNames.push_back(key);
+    mStageHistory.emplace_back(mFrames.size(), 0.f);
+    return index;
+}
+
+void Profiler::AddEvent(long long frameIndex, const ProfileEvent& event) {
+    // GPU results come back late, drop the ones whose frame has already left the ring
+    if (frameIndex > mFrameIndex || mFrameIndex - frameIndex >= (long long)mFrames.size())
+        return;
+    auto& frame = mFrames[frameIndex % (long long)mFrames.size()];
+    if (frame.events.size() >= sMaxEventsPerFrame)
+        return;
+    frame.events.push_back(event);
+    int slot = (int)(frameIndex % (long long)mFrames.size());
+    mStageHistory[StageIndex(event.name, event.gpu)][slot] += (float)(event.duration / 1000.0);
+}
+
+void Profiler::BeginCpu(const char* name) {
+    mScopes.push_back({name, Now()});
+}
+
+void Profiler::EndCpu() {
+    if (mScopes.empty())
+        return;
+    auto scope = mScopes.back();
+    mScopes.pop_back();
+    AddEvent(mFrameIndex, {scope.name, scope.begin, Now() - scope.begin, (int)mScopes.size(), false});
+}
+
+void Profiler::BeginGpu(const char* name) {
+    if (!mGpuSupported || mGpuDepth++ > 0)
+        return;
+    if (!glGenQueries) {
+        mGpuSupported = false;
+        mGpuDepth     = 0;
+        return;
+    }
+    if (mFreeQueries.empty()) {
+        GLuint queries[16];
+        glGenQueries(16, queries);
+        mFreeQueries.insert(mFreeQueries.end(), queries, queries + 16);
+    }
+    mGpuScope = {mFreeQueries.back(), mFrameIndex, name, Now()};
+    mFreeQueries.pop_back();
+    glBeginQuery(GL_TIME_ELAPSED, mGpuScope.query);
+}
+
+void Profiler::EndGpu() {
+    if (!mGpuSupported || mGpuDepth == 0 || --mGpuDepth > 0)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    mPendingQueries.push_back(mGpuScope);
+}
+
+void Profiler::ResolveQueries() {
+    // queries finish in submission order, stop at the first one that is not ready
+    while (!mPendingQueries.empty()) {
+        auto  pending   = mPendingQueries.front();
+        GLint available = 0;
+        glGetQueryObjectiv(pending.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(pending.query, GL_QUERY_RESULT, &elapsed);
+        mPendingQueries.pop_front();
+        mFreeQueries.push_back(pending.query);
+        AddEvent(pending.frameIndex, {pending.name, pending.begin, (double)elapsed / 1000.0, 0, true});
+    }
+}
+
+void Profiler::DrawOverlay() {
+    if (!mShowOverlay)
+        return;
+
+    int count  = (int)mFrames.size();
+    int offset = (int)((mFrameIndex + 1) % count);   // oldest slot first
+    ImGui::SetNextWindowBgAlpha(0.8f);
+    ImGui::Begin("Profiler", &mShowOverlay, ImGuiWindowFlags_AlwaysAutoResize);
+    for (int i = 0; i < (int)mStageNames.size(); i++) {
+        const auto& history = mStageHistory[i];
+        float       total   = 0.f;
+        float       peak    = 0.f;
+        for (float t : history) {
+            total += t;
+            peak = std::max(peak, t);
+        }
+        auto overlay = fmt::format("avg {:.3f} ms  max {:.3f} ms", total / (float)count, peak);
+        ImGui::PlotLines(mStageNames[i].c_str(),
+                         history.data(),
+                         count,
+                         offset,
+                         overlay.c_str(),
+                         0.f,
+                         FLT_MAX,
+                         ImVec2(300, 40));
+    }
+    if (ImGui::Button("Export Chrome trace")) {
+        ExportChromeTrace(mTracePath);
+    }
+    ImGui::End();
+}
+
+static std::string sJsonEscape(const char* str) {
+    std::string out;
+    for (const char* c = str; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            out += '\\';
+        }
+        out += *c;
+    }
+    return out;
+}
+
+bool Profiler::ExportChromeTrace(const std::string& file) const {
+    std::ofstream out(file);
+    if (!out.is_open()) {
+        spdlog::error("File not open: {}", file);
+        return false;
+    }
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+           "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n"
+           "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+
+    int eventCount = 0;
+    int count      = (int)mFrames.size();
+    for (int i = 1; i <= count; i++) {
+        // oldest to newest, the current (unfinished) frame is left out
+        const auto& frame = mFrames[(mFrameIndex + i) % count];
+        if (frame.index < 0 || frame.index >= mFrameIndex)
+            continue;
+        out << fmt::format(",\n{{\"name\":\"Frame {}\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},"
+                           "\"pid\":1,\"tid\":1}}",
+                           frame.index,
+                           frame.begin,
+                           frame.end - frame.begin);
+        for (const auto& event : frame.events) {
+            out << fmt::format(",\n{{\"name\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},"
+                               "\"pid\":1,\"tid\":{}}}",
+                               sJsonEscape(event.name),
+                               event.begin,
+                               event.duration,
+                               event.gpu ? 2 : 1);
+            eventCount++;
+        }
+    }
+    out << "\n]}\n";
+    spdlog::info("Chrome trace with {} events written to {}", eventCount, file);
+    return true;
+}
+
+void Profiler::Destroy() {
+    for (const auto& pending : mPendingQueries) {
+        mFreeQueries.push_back(pending.query);
+    }
+    mPendingQueries.clear();
+    if (!mFreeQueries.empty()) {
+        glDeleteQueries((GLsizei)mFreeQueries.size(), mFreeQueries.data());
+        mFreeQueries.clear();
+    }
+}
@@ -0,0 +1,115 @@
+//
+// Created by ChenhuiWang on 2024/5/8.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_PROFILER_H
+#define CODEGRAPH_PROFILER_H
+
+#include "glad/gl.h"
+#include <chrono>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ProfileEvent {
+    const char* name;
+    double      begin;      // us since the profiler was created
+    double      duration;   // us
+    int         depth;
+    bool        gpu;
+};
+
+struct ProfileFrame {
+    long long                 index = -1;
+    double                    begin = 0.0;
+    double                    end   = 0.0;
+    std::vector<ProfileEvent> events;
+};
+
+class Profiler {
+    /// Per-stage frame profiler. CPU scopes are timed with steady_clock, GPU scopes with
+    /// GL_TIME_ELAPSED queries that are read back a few frames later to avoid stalls.
+    /// The last mFrames.size() frames are kept in a ring buffer.
+public:
+    explicit Profiler(int frameCount = 300);
+
+    void BeginFrame();
+    void EndFrame();
+
+    void BeginCpu(const char* name);
+    void EndCpu();
+
+    /// GL_TIME_ELAPSED queries cannot nest, inner GPU scopes are ignored
+    void BeginGpu(const char* name);
+    void EndGpu();
+
+    /// ImGui window with one graph per stage, call between ImGui::NewFrame and ImGui::Render
+    void DrawOverlay();
+
+    bool ExportChromeTrace(const std::string& file) const;
+
+    /// release the GL queries, needs a current GL context
+    void Destroy();
+
+public:
+    bool        mShowOverlay = false;
+    std::string mTracePath   = "codegraph_trace.json";
+
+private:
+    struct OpenScope {
+        const char* name;
+        double      begin;
+    };
+
+    struct PendingQuery {
+        GLuint      query;
+        long long   frameIndex;
+        const char* name;
+        double      begin;
+    };
+
+    double        Now() const;
+    ProfileFrame& CurrentFrame() { return mFrames[mFrameIndex % (long long)mFrames.size()]; }
+    void          AddEvent(long long frameIndex, const ProfileEvent& event);
+    int           StageIndex(const char* name, bool gpu);
+    void          ResolveQueries();
+
+    std::chrono::steady_clock::time_point mOrigin;
+    std::vector<ProfileFrame>             mFrames;
+    long long                             mFrameIndex = 0;
+    std::vector<OpenScope>                mScopes;
+
+    std::vector<std::string>             mStageNames;
+    std::vector<std::vector<float>>      mStageHistory;   // ms per frame, same ring as mFrames
+    std::unordered_map<std::string, int> mStageLookup;
+
+    bool                     mGpuSupported = true;
+    int                      mGpuDepth     = 0;
+    PendingQuery             mGpuScope{};
+    std::vector<GLuint>      mFreeQueries;
+    std::deque<PendingQuery> mPendingQueries;
+};
+
+extern Profiler gProfiler;
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name) { gProfiler.BeginCpu(name); }
+    ~ProfileScope() { gProfiler.EndCpu(); }
+};
+
+class ProfileGpuScope {
+public:
+    explicit ProfileGpuScope(const char* name) { gProfiler.BeginGpu(name); }
+    ~ProfileGpuScope() { gProfiler.EndGpu(); }
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b)      PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_SCOPE(name)       ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name)   ProfileGpuScope PROFILE_CONCAT(profileGpuScope, __LINE__)(name)
+
+#endif   // CODEGRAPH_PROFILER_H
@@ -0,0 +1,153 @@
+//
+// Created by ChenhuiWang on 2024/5/17.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_ROWPYRAMID_H
+#define CODEGRAPH_ROWPYRAMID_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+class RowPyramid {
+    /// Level of detail for the list layout. Level 0 summarizes blocks of sBaseRows consecutive
+    /// rows, every level above merges sFanout blocks of the one below. A block keeps the depth
+    /// range and right edge of its rows, so it can be drawn as one band, and the color most of its
+    /// rows use. Dominant colors are exact on level 0 and merged from the children's dominant
+    /// colors above, which is close enough for a band a few pixels high.
+    /// Rows are only ever appended, Update rebuilds the blocks from the first changed row on.
+public:
+    struct Row {
+        int      level;
+        float    right;       // right edge of the box
+        uint16_t color;       // index into the caller's palette
+        bool     highlight;   // search hit, wins over the dominant color
+    };
+
+    struct Block {
+        int      minLevel;
+        int      maxLevel;
+        float    right;
+        uint16_t color;
+        bool     highlight;
+        uint32_t colorRows;   // rows (estimated above level 0) using color
+    };
+
+    static constexpr int sBaseRows = 8;
+    static constexpr int sFanout   = 4;
+
+    /// make the pyramid cover rowCount rows, where rows before firstRow did not change.
+    /// row(i) returns the Row of row i
+    template<typename RowFn> void Update(int rowCount, int firstRow, const RowFn& row) {
+        int first = std::min(firstRow, mRowCount) / sBaseRows;
+        int count = (rowCount + sBaseRows - 1) / sBaseRows;
+        mRowCount = rowCount;
+        if (mLevels.empty()) {
+            mLevels.emplace_back();
+        }
+
+        auto& base = mLevels[0];
+        base.resize(count);
+        for (int b = first; b < count; b++) {
+            int end = std::min(rowCount, (b + 1) * sBaseRows);
+            Row rows[sBaseRows];
+            int n = 0;
+            for (int i = b * sBaseRows; i < end; i++) {
+                rows[n++] = row(i);
+            }
+            Block block{rows[0].level, rows[0].level, rows[0].right, 0, false, 0};
+            for (int k = 0; k < n; k++) {
+                block.minLevel = std::min(block.minLevel, rows[k].level);
+                block.maxLevel = std::max(block.maxLevel, rows[k].level);
+                block.right    = std::max(block.right, rows[k].right);
+                block.highlight |= rows[k].highlight;
+                auto uses = (uint32_t)std::count_if(
+                    rows, rows + n, [&](const Row& r) { return r.color == rows[k].color; });
+                if (uses > block.colorRows) {
+                    block.color     = rows[k].color;
+                    block.colorRows = uses;
+                }
+            }
+            base[b] = block;
+        }
+
+        size_t level = 1;
+        for (; count > 1; level++) {
+            first = first / sFanout;
+            count = (count + sFanout - 1) / sFanout;
+            if (level == mLevels.size()) {
+                mLevels.emplace_back();
+            }
+            const auto& below = mLevels[level - 1];
+            auto&       above = mLevels[level];
+            above.resize(count);
+            for (int b = first; b < count; b++) {
+                int begin = b * sFanout;
+                int end   = std::min((int)below.size(), begin + sFanout);
+                above[b]  = Merge(below.data() + begin, end - begin);
+            }
+        }
+        mLevels.resize(level);
+    }
+
+    void Clear() {
+        mLevels.clear();
+        mRowCount = 0;
+    }
+
+    int RowCount() const { return mRowCount; }
+
+    int Levels() const { return (int)mLevels.size(); }
+
+    static int sRowsPerBlock(int level) {
+        int rows = sBaseRows;
+        for (int k = 0; k < level; k++) {
+            rows *= sFanout;
+        }
+        return rows;
+    }
+
+    /// finest level whose blocks are at least a pixel high
+    int LevelFor(float rowPixels) const {
+        int level = 0;
+        while (level + 1 < Levels() && (float)sRowsPerBlock(level) * rowPixels < 1.f) {
+            level++;
+        }
+        return level;
+    }
+
+    const std::vector<Block>& GetLevel(int level) const { return mLevels[level]; }
+
+private:
+    static Block Merge(const Block* children, int n) {
+        Block block = children[0];
+        for (int k = 1; k < n; k++) {
+            block.minLevel = std::min(block.minLevel, children[k].minLevel);
+            block.maxLevel = std::max(block.maxLevel, children[k].maxLevel);
+            block.right    = std::max(block.right, children[k].right);
+            block.highlight |= children[k].highlight;
+        }
+        // add up the children that agree on a color, the largest total wins
+        block.colorRows = 0;
+        for (int k = 0; k < n; k++) {
+            uint32_t rows = 0;
+            for (int j = 0; j < n; j++) {
+                if (children[j].color == children[k].color) {
+                    rows += children[j].colorRows;
+                }
+            }
+            if (rows > block.colorRows) {
+                block.color     = children[k].color;
+                block.colorRows = rows;
+            }
+        }
+        return block;
+    }
+
+    std::vector<std::vector<Block>> mLevels;
+    int                             mRowCount = 0;
+};
+
+#endif   // CODEGRAPH_ROWPYRAMID_H
@@ -0,0 +1,75 @@
+//
+// Created by ChenhuiWang on 2024/6/1.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_SMOOTHINGKERNELS_H
+#define CODEGRAPH_SMOOTHINGKERNELS_H
+
+#include <string>
+
+// Weights of the neighbors as policies: Weight(q) of the distance over the support radius,
+// q in [0, 1), 0 from q = 1 on. Loops take the policy as a template argument so the weight is
+// inlined. Only the shape matters: the anisotropy normalizes by the total weight, so the
+// constants that make a kernel integrate to one are left out.
+
+/// Yu and Turk's 1 - q^3
+struct CubicFalloffKernel {
+    static constexpr const char* sName = "cubic";
+
+    static double Weight(double q) { return 1.0 - q * q * q; }
+};
+
+/// Mueller's poly6, (1 - q^2)^3
+struct Poly6Kernel {
+    static constexpr const char* sName = "poly6";
+
+    static double Weight(double q) {
+        double s = 1.0 - q * q;
+        return s * s * s;
+    }
+};
+
+/// Monaghan's cubic B-spline, the support radius is 2h
+struct CubicSplineKernel {
+    static constexpr const char* sName = "spline";
+
+    static double Weight(double q) {
+        if (q < 0.5)
+            return 1.0 - 6.0 * q * q * (1.0 - q);
+        double s = 1.0 - q;
+        return 2.0 * s * s * s;
+    }
+};
+
+/// Wendland C2, (1 - q)^4 (1 + 4q)
+struct WendlandKernel {
+    static constexpr const char* sName = "wendland";
+
+    static double Weight(double q) {
+        double s = 1.0 - q;
+        return s * s * s * s * (1.0 + 4.0 * q);
+    }
+};
+
+/// runtime choice of a policy, the index into dispatch tables
+enum class KernelType { Cubic, Poly6, Spline, Wendland, Count };
+
+static const char* const sKernelNames[] = {CubicFalloffKernel::sName,
+                                           Poly6Kernel::sName,
+                                           CubicSplineKernel::sName,
+                                           WendlandKernel::sName};
+
+/// the kernel called name, false for none
+static inline bool sParseKernel(const std::string& name, KernelType& type) {
+    for (int k = 0; k < (int)KernelType::Count; k++) {
+        if (name == sKernelNames[k]) {
+            type = (KernelType)k;
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif   // CODEGRAPH_SMOOTHINGKERNELS_H
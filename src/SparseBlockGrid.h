@@ -0,0 +1,122 @@
+//
+// Created by ChenhuiWang on 2024/5/30.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_SPARSEBLOCKGRID_H
+#define CODEGRAPH_SPARSEBLOCKGRID_H
+
+#include <Eigen/Dense>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+template<int Dim> class SparseBlockGrid {
+    /// Scalar samples on a regular lattice with the given spacing, stored in blocks of
+    /// sBlockSize^Dim samples. Only blocks that were touched exist, everything else reads as 0,
+    /// so memory follows the occupied region rather than its bounding box. A block's samples are
+    /// contiguous, x fastest. Blocks are found through a hash map of their coordinates.
+public:
+    using Vec  = Eigen::Matrix<double, Dim, 1>;
+    using Cell = std::array<int, Dim>;
+
+    static constexpr int sBlockShift   = 3;
+    static constexpr int sBlockSize    = 1 << sBlockShift;
+    static constexpr int sBlockSamples = 1 << (sBlockShift * Dim);
+
+    /// drop every block
+    void Reset(double spacing) {
+        mSpacing = spacing;
+        mBlocks.clear();
+        mOrigins.clear();
+        mValues.clear();
+    }
+
+    double Spacing() const { return mSpacing; }
+
+    int BlockCount() const { return (int)mOrigins.size(); }
+
+    /// index of the block with block coordinates block, allocated and zeroed if it is new
+    int Touch(const Cell& block) {
+        auto [it, inserted] = mBlocks.try_emplace(sKey(block), BlockCount());
+        if (inserted) {
+            mOrigins.push_back(block);
+            mValues.resize(mValues.size() + sBlockSamples, 0.f);
+        }
+        return it->second;
+    }
+
+    /// index of the block or -1
+    int Find(const Cell& block) const {
+        auto it = mBlocks.find(sKey(block));
+        return it == mBlocks.end() ? -1 : it->second;
+    }
+
+    /// block coordinates of block b, its first sample is BlockOrigin(b) * sBlockSize
+    const Cell& BlockOrigin(int b) const { return mOrigins[b]; }
+
+    float* Block(int b) { return mValues.data() + (size_t)b * sBlockSamples; }
+
+    const float* Block(int b) const { return mValues.data() + (size_t)b * sBlockSamples; }
+
+    /// offset of a sample inside its block, local coordinates in [0, sBlockSize)
+    static int sLocalIndex(const Cell& local) {
+        int index = 0;
+        for (int d = Dim - 1; d >= 0; d--) {
+            index = (index << sBlockShift) | local[d];
+        }
+        return index;
+    }
+
+    /// block coordinates of the block holding a sample
+    static Cell sBlockOf(const Cell& sample) {
+        Cell block;
+        for (int d = 0; d < Dim; d++) {
+            block[d] = sample[d] >> sBlockShift;   // floor for negative samples too
+        }
+        return block;
+    }
+
+    /// value at sample coordinates, 0 outside the allocated blocks
+    float Sample(const Cell& sample) const {
+        int b = Find(sBlockOf(sample));
+        if (b < 0)
+            return 0.f;
+        Cell local;
+        for (int d = 0; d < Dim; d++) {
+            local[d] = sample[d] & (sBlockSize - 1);
+        }
+        return Block(b)[sLocalIndex(local)];
+    }
+
+    Vec Position(const Cell& sample) const {
+        Vec p;
+        for (int d = 0; d < Dim; d++) {
+            p[d] = sample[d] * mSpacing;
+        }
+        return p;
+    }
+
+    /// bytes held by the samples
+    size_t MemoryBytes() const { return mValues.size() * sizeof(float); }
+
+private:
+    /// 21 bits per coordinate, enough for 2^24 samples per axis
+    static uint64_t sKey(const Cell& block) {
+        uint64_t key = 0;
+        for (int d = 0; d < Dim; d++) {
+            key = (key << 21) | ((uint64_t)(uint32_t)block[d] & 0x1fffffull);
+        }
+        return key;
+    }
+
+    double                            mSpacing = 1.0;
+    std::unordered_map<uint64_t, int> mBlocks;    // block coordinates -> block index
+    std::vector<Cell>                 mOrigins;   // block coordinates per block index
+    std::vector<float>                mValues;    // sBlockSamples per block index
+};
+
+#endif   // CODEGRAPH_SPARSEBLOCKGRID_H
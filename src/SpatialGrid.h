@@ -0,0 +1,176 @@
+//
+// Created by ChenhuiWang on 2024/5/20.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_SPATIALGRID_H
+#define CODEGRAPH_SPATIALGRID_H
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+template<int Dim> class SpatialGrid {
+    /// Cell list for fixed radius and k nearest neighbor queries. Space is cut into cubes with an
+    /// edge of cellSize, each cell is hashed into a table with about as many buckets as there are
+    /// points, and the points are counting sorted by bucket. A query with a radius up to cellSize
+    /// looks at the 3^Dim cells around the query point only. Positions are copied in bucket order,
+    /// so the points of one cell are contiguous in memory. Memory is O(n), however sparse the
+    /// points are.
+public:
+    using Vec  = Eigen::Matrix<double, Dim, 1>;
+    using Cell = std::array<int, Dim>;
+
+    void Build(const std::vector<Vec>& points, double cellSize) {
+        mCellSize = cellSize;
+        size_t buckets = 1;
+        while (buckets < points.size()) {
+            buckets *= 2;
+        }
+        mMask = buckets - 1;
+
+        std::vector<size_t> bucketOf(points.size());
+        mBucketStart.assign(buckets + 1, 0);
+        for (size_t i = 0; i < points.size(); i++) {
+            bucketOf[i] = Bucket(CellOf(points[i]));
+            mBucketStart[bucketOf[i] + 1]++;
+        }
+        for (size_t b = 0; b < buckets; b++) {
+            mBucketStart[b + 1] += mBucketStart[b];
+        }
+
+        mIds.resize(points.size());
+        mPoints.resize(points.size());
+        mCells.resize(points.size());
+        std::vector<int> cursor(mBucketStart.begin(), mBucketStart.end() - 1);
+        for (size_t i = 0; i < points.size(); i++) {
+            int k      = cursor[bucketOf[i]]++;
+            mIds[k]    = (int)i;
+            mPoints[k] = points[i];
+            mCells[k]  = CellOf(points[i]);
+        }
+    }
+
+    /// visitor(j, distance) for every point j closer than radius (at most the cell size) to p,
+    /// including p itself if it is one of the points
+    template<typename Visitor>
+    void ForEachNeighbor(const Vec& p, double radius, const Visitor& visitor) const {
+        Cell   center  = CellOf(p);
+        double radius2 = radius * radius;
+        int    cells   = 1;
+        for (int d = 0; d < Dim; d++) {
+            cells *= 3;
+        }
+        for (int offset = 0; offset < cells; offset++) {
+            Cell cell = center;
+            for (int d = 0, o = offset; d < Dim; d++, o /= 3) {
+                cell[d] += o % 3 - 1;
+            }
+            size_t b = Bucket(cell);
+            for (int k = mBucketStart[b]; k < mBucketStart[b + 1]; k++) {
+                // other cells can share the bucket
+                if (mCells[k] != cell)
+                    continue;
+                double d2 = (mPoints[k] - p).squaredNorm();
+                if (d2 < radius2) {
+                    visitor(mIds[k], std::sqrt(d2));
+                }
+            }
+        }
+    }
+
+    /// the k points closest to p and closer than maxRadius into nearest as (distance, j), nearest
+    /// first. Rings of cells around p are visited until no unvisited cell can hold a closer point
+    /// than the k-th one found. nearest is reused between queries to save the allocation.
+    void FindNearest(const Vec& p, int k, double maxRadius,
+                     std::vector<std::pair<double, int>>& nearest) const {
+        nearest.clear();
+        if (k <= 0)
+            return;
+        Cell center = CellOf(p);
+        // every point closer than reach is found once the rings up to ring are visited
+        double wall = mCellSize;
+        for (int d = 0; d < Dim; d++) {
+            double lower = p[d] - center[d] * mCellSize;
+            wall         = std::min(wall, std::min(lower, mCellSize - lower));
+        }
+        double maxRadius2 = maxRadius * maxRadius;
+        for (int ring = 0;; ring++) {
+            int side  = 2 * ring + 1;
+            int cells = 1;
+            for (int d = 0; d < Dim; d++) {
+                cells *= side;
+            }
+            for (int offset = 0; offset < cells; offset++) {
+                Cell cell   = center;
+                bool inside = true;
+                for (int d = 0, o = offset; d < Dim; d++, o /= side) {
+                    int delta = o % side - ring;
+                    cell[d] += delta;
+                    inside = inside && std::abs(delta) < ring;
+                }
+                // the inner rings are done
+                if (inside)
+                    continue;
+                size_t b = Bucket(cell);
+                for (int i = mBucketStart[b]; i < mBucketStart[b + 1]; i++) {
+                    if (mCells[i] != cell)
+                        continue;
+                    double d2 = (mPoints[i] - p).squaredNorm();
+                    if (d2 < maxRadius2) {
+                        nearest.emplace_back(d2, mIds[i]);
+                    }
+                }
+            }
+            // all candidates are kept, a selection per ring is cheaper than a heap per candidate
+            double reach = ring * mCellSize + wall;
+            if ((int)nearest.size() >= k) {
+                std::nth_element(nearest.begin(), nearest.begin() + (k - 1), nearest.end());
+                if (nearest[k - 1].first <= reach * reach) {
+                    nearest.resize(k);
+                    break;
+                }
+            }
+            if (reach >= maxRadius)
+                break;
+        }
+        std::sort(nearest.begin(), nearest.end());
+        nearest.resize(std::min((int)nearest.size(), k));
+        for (auto& entry : nearest) {
+            entry.first = std::sqrt(entry.first);
+        }
+    }
+
+private:
+    Cell CellOf(const Vec& p) const {
+        Cell cell;
+        for (int d = 0; d < Dim; d++) {
+            cell[d] = (int)std::floor(p[d] / mCellSize);
+        }
+        return cell;
+    }
+
+    size_t Bucket(const Cell& cell) const {
+        // the usual large primes for spatial hashing
+        static const uint32_t sPrimes[3] = {73856093u, 19349663u, 83492791u};
+        uint32_t              hash       = 0;
+        for (int d = 0; d < Dim; d++) {
+            hash ^= (uint32_t)cell[d] * sPrimes[d];
+        }
+        return hash & mMask;
+    }
+
+    double            mCellSize = 1.0;
+    size_t            mMask     = 0;
+    std::vector<int>  mBucketStart;   // CSR offsets into the arrays below, one per bucket
+    std::vector<int>  mIds;           // index into the points given to Build
+    std::vector<Vec>  mPoints;
+    std::vector<Cell> mCells;
+};
+
+#endif   // CODEGRAPH_SPATIALGRID_H
@@ -0,0 +1,98 @@
+//
+// Created by ChenhuiWang on 2024/5/13.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_STRINGTABLE_H
+#define CODEGRAPH_STRINGTABLE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class StringTable {
+    /// Interns strings to dense 32-bit ids. All characters live back to back in one arena, each
+    /// string followed by '\0' so Get(id).data() can be handed to C APIs. The lookup table is open
+    /// addressing over ids and keeps the hash next to the id, so a probe rarely touches the arena.
+    /// Views returned by Get stay valid until the next Intern.
+public:
+    static constexpr uint32_t sInvalidId = ~0u;
+
+    StringTable() { mSlots.assign(256, {sInvalidId, 0}); }
+
+    uint32_t Intern(std::string_view str) {
+        size_t hash = std::hash<std::string_view>()(str);
+        size_t slot = FindSlot(str, hash);
+        if (mSlots[slot].id != sInvalidId)
+            return mSlots[slot].id;
+
+        auto id = (uint32_t)mOffsets.size();
+        mOffsets.push_back(mArena.size());
+        mArena.append(str);
+        mArena.push_back('\0');
+        mSlots[slot] = {id, hash};
+        // keep the load factor under 1/2 so probe sequences stay short
+        if (2 * mOffsets.size() > mSlots.size()) {
+            Rehash(2 * mSlots.size());
+        }
+        return id;
+    }
+
+    /// sInvalidId if str was never interned
+    uint32_t Find(std::string_view str) const {
+        return mSlots[FindSlot(str, std::hash<std::string_view>()(str))].id;
+    }
+
+    std::string_view Get(uint32_t id) const {
+        size_t begin = mOffsets[id];
+        size_t end   = id + 1 < mOffsets.size() ? mOffsets[id + 1] : mArena.size();
+        return {mArena.data() + begin, end - begin - 1};
+    }
+
+    uint32_t Size() const { return (uint32_t)mOffsets.size(); }
+
+    /// bytes used by the arena and the tables
+    size_t MemoryUsage() const {
+        return mArena.capacity() + mOffsets.capacity() * sizeof(size_t) +
+               mSlots.capacity() * sizeof(Slot);
+    }
+
+private:
+    struct Slot {
+        uint32_t id;
+        size_t   hash;
+    };
+
+    size_t FindSlot(std::string_view str, size_t hash) const {
+        size_t mask = mSlots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const auto& slot = mSlots[i];
+            if (slot.id == sInvalidId || (slot.hash == hash && Get(slot.id) == str))
+                return i;
+        }
+    }
+
+    void Rehash(size_t capacity) {
+        std::vector<Slot> slots(capacity, {sInvalidId, 0});
+        size_t            mask = capacity - 1;
+        for (const auto& slot : mSlots) {
+            if (slot.id == sInvalidId)
+                continue;
+            size_t i = slot.hash & mask;
+            while (slots[i].id != sInvalidId) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = slot;
+        }
+        mSlots.swap(slots);
+    }
+
+    std::string         mArena;
+    std::vector<size_t> mOffsets;
+    std::vector<Slot>   mSlots;
+};
+
+#endif   // CODEGRAPH_STRINGTABLE_H
@@ -0,0 +1,115 @@
+//
+// Created by ChenhuiWang on 2024/5/22.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool gThreadPool;
+
+static thread_local bool sInsideBody = false;
+
+ThreadPool::ThreadPool(int threads) {
+    SetThreadCount(threads);
+}
+
+ThreadPool::~ThreadPool() {
+    Stop();
+}
+
+void ThreadPool::SetThreadCount(int threads) {
+    std::lock_guard<std::mutex> lock(mCallMutex);
+    Stop();
+    if (threads <= 0) {
+        threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    }
+    mThreadCount = threads;
+}
+
+void ThreadPool::Start() {
+    uint64_t job;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = false;
+        job   = mJob;
+    }
+    // jobs up to now ran before these workers existed, they must not count as new ones
+    for (int t = 1; t < mThreadCount; t++) {
+        mWorkers.emplace_back([this, job]() { WorkerLoop(job); });
+    }
+}
+
+void ThreadPool::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mWake.notify_all();
+    for (auto& worker : mWorkers) {
+        worker.join();
+    }
+    mWorkers.clear();
+}
+
+void ThreadPool::ParallelFor(int begin, int end, int grain,
+                             const std::function<void(int, int)>& body) {
+    grain = std::max(1, grain);
+    if (sInsideBody || mThreadCount == 1 || sChunkCount(begin, end, grain) <= 1) {
+        for (int b = begin; b < end; b += grain) {
+            body(b, std::min(end, b + grain));
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> call(mCallMutex);
+    if (mWorkers.empty()) {
+        Start();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mBody    = &body;
+        mBegin   = begin;
+        mEnd     = end;
+        mGrain   = grain;
+        mPending = (int)mWorkers.size();
+        mNextChunk.store(0, std::memory_order_relaxed);
+        mJob++;
+    }
+    mWake.notify_all();
+    RunChunks();
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDone.wait(lock, [this]() { return mPending == 0; });
+    mBody = nullptr;
+}
+
+void ThreadPool::WorkerLoop(uint64_t seen) {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWake.wait(lock, [&]() { return mStop || mJob != seen; });
+            if (mStop)
+                return;
+            seen = mJob;
+        }
+        RunChunks();
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (--mPending == 0) {
+                mDone.notify_one();
+            }
+        }
+    }
+}
+
+void ThreadPool::RunChunks() {
+    sInsideBody = true;
+    int chunks  = sChunkCount(mBegin, mEnd, mGrain);
+    for (int c = mNextChunk.fetch_add(1); c < chunks; c = mNextChunk.fetch_add(1)) {
+        int b = mBegin + c * mGrain;
+        (*mBody)(b, std::min(mEnd, b + mGrain));
+    }
+    sInsideBody = false;
+}
@@ -0,0 +1,75 @@
+//
+// Created by ChenhuiWang on 2024/5/22.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_THREADPOOL_H
+#define CODEGRAPH_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+    /// Persistent workers behind ParallelFor. A loop is cut into chunks of a fixed grain, the
+    /// caller and the workers take the next chunk from an atomic counter until none is left, so
+    /// threads that finish early keep pulling work. Chunk boundaries only depend on the range and
+    /// the grain, never on the thread count or timing: a body that writes nothing but its own
+    /// indices gives bit-identical results however it is scheduled.
+    /// Workers start with the first ParallelFor. Calls from inside a body run serially, calls
+    /// from different threads take turns.
+public:
+    /// threads includes the caller, 0 uses every hardware thread
+    explicit ThreadPool(int threads = 0);
+    ~ThreadPool();
+
+    void SetThreadCount(int threads);
+
+    int ThreadCount() const { return mThreadCount; }
+
+    /// body(chunkBegin, chunkEnd) over [begin, end) in chunks of grain indices
+    void ParallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body);
+
+    /// number of chunks ParallelFor cuts [begin, end) into, chunk c starts at begin + c * grain
+    static int sChunkCount(int begin, int end, int grain) {
+        return end > begin ? (end - begin + grain - 1) / grain : 0;
+    }
+
+private:
+    void Start();
+    void Stop();
+    /// seen: the last job before the worker started
+    void WorkerLoop(uint64_t seen);
+    void RunChunks();
+
+    int                      mThreadCount = 1;
+    std::vector<std::thread> mWorkers;
+    std::mutex               mCallMutex;   // one ParallelFor at a time
+
+    std::mutex              mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mDone;
+    uint64_t                mJob     = 0;
+    int                     mPending = 0;   // workers that have not finished the current job
+    bool                    mStop    = false;
+
+    const std::function<void(int, int)>* mBody  = nullptr;
+    int                                  mBegin = 0;
+    int                                  mEnd   = 0;
+    int                                  mGrain = 1;
+    std::atomic<int>                     mNextChunk{0};
+};
+
+extern ThreadPool gThreadPool;
+
+/// gThreadPool.ParallelFor
+inline void ParallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body) {
+    gThreadPool.ParallelFor(begin, end, grain, body);
+}
+
+#endif   // CODEGRAPH_THREADPOOL_H
@@ -0,0 +1,114 @@
+//
+// Created by ChenhuiWang on 2024/5/31.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+#ifndef CODEGRAPH_VERLETLIST_H
+#define CODEGRAPH_VERLETLIST_H
+
+#include "NeighborList.h"
+#include "SpatialGrid.h"
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+template<int Dim> class VerletList {
+    /// Neighbor candidates kept across the frames of a sequence: the points within radius + skin
+    /// of each other, found once on a grid with cells of that size. As long as no point moved more
+    /// than skin / 2 since then, no pair can have come closer than radius without being a
+    /// candidate, and the neighbors of a frame are found by filtering the candidates.
+    /// Points are tracked by id, their order is the one of the frame the candidates were built
+    /// on: slot k holds the point with id Id(k).
+public:
+    using Vec = Eigen::Matrix<double, Dim, 1>;
+
+    /// candidates of points in slot order, ids[k] the id of points[k]
+    void Rebuild(const SpatialGrid<Dim>& grid, const std::vector<Vec>& points, std::vector<int> ids,
+                 double radius, double skin) {
+        mRadius    = radius;
+        mSkin      = skin;
+        mIds       = std::move(ids);
+        mPositions = points;
+        mCandidates.Build(grid, points, radius + skin);
+    }
+
+    /// sort the candidate lists by id, lists filtered from them keep that order
+    void SortById() { mCandidates.SortBy(mIds); }
+
+    /// forget the candidates, the next frame rebuilds them
+    void Clear() {
+        mIds.clear();
+        mPositions.clear();
+        mCandidates = {};
+    }
+
+    /// candidates for neighbors within radius, built with skin
+    bool Fits(double radius, double skin) const {
+        return !mIds.empty() && mRadius == radius && mSkin == skin;
+    }
+
+    /// order[k] = index of the point with id Id(k) in a frame of n points with the given ids, null
+    /// for ids equal to the indices. False if the frame does not hold exactly the tracked ids.
+    bool Match(const int* ids, int n, std::vector<int>& order) const {
+        if (n != (int)mIds.size())
+            return false;
+        order.resize(n);
+        if (!ids) {
+            for (int k = 0; k < n; k++) {
+                if (mIds[k] < 0 || mIds[k] >= n)
+                    return false;
+                order[k] = mIds[k];
+            }
+            return true;
+        }
+        // ids are usually 0 to n - 1 in some order, a table is much faster than a hash map then
+        int  upper = n > 0 ? *std::max_element(ids, ids + n) : 0;
+        int  lower = n > 0 ? *std::min_element(ids, ids + n) : 0;
+        bool dense = lower >= 0 && upper < 4 * n;
+        std::vector<int>             table(dense ? upper + 1 : 0, -1);
+        std::unordered_map<int, int> map;
+        for (int i = 0; i < n; i++) {
+            int& slot = dense ? table[ids[i]] : map.try_emplace(ids[i], -1).first->second;
+            if (slot >= 0)
+                return false;   // an id twice
+            slot = i;
+        }
+        for (int k = 0; k < n; k++) {
+            int id = mIds[k];
+            if (dense) {
+                order[k] = id >= 0 && id <= upper ? table[id] : -1;
+            } else {
+                auto it  = map.find(id);
+                order[k] = it == map.end() ? -1 : it->second;
+            }
+            if (order[k] < 0)
+                return false;
+        }
+        return true;
+    }
+
+    /// largest distance of a point in slot order from where it was when the candidates were built
+    double MaxDisplacement(const std::vector<Vec>& points) const {
+        double max2 = 0.0;
+        for (size_t k = 0; k < points.size(); k++) {
+            max2 = std::max(max2, (points[k] - mPositions[k]).squaredNorm());
+        }
+        return std::sqrt(max2);
+    }
+
+    int Id(int k) const { return mIds[k]; }
+
+    const NeighborList& Candidates() const { return mCandidates; }
+
+private:
+    double           mRadius = 0.0;
+    double           mSkin   = 0.0;
+    std::vector<int> mIds;          // per slot
+    std::vector<Vec> mPositions;    // per slot, at build time
+    NeighborList     mCandidates;   // indices are slots
+};
+
+#endif   // CODEGRAPH_VERLETLIST_H
@@ -0,0 +1,403 @@
+//
+// Created by ChenhuiWang on 2024/5/25.
+
+// Copyright (c) 2024 Tencent. All rights reserved.
+//
+
+// Headless 3D anisotropy over a particle cache or a sequence of them: every frame is read,
+// the anisotropic kernel of every particle computed and the frame written back with the kernel
+// matrices as an attribute. Reading, computing and writing run as a pipeline, frame k + 1 is read
+// and frame k - 1 written while frame k is computed. Optionally the fluid surface of every frame
+// is extracted from the kernels and written as an OBJ mesh.
+
+#include "Anisotropy.h"
+#include "BoundedQueue.h"
+#include "Isosurface.h"
+#include <partio/src/lib/Partio.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+
+/// kernel matrix G, row major, 9 floats per particle
+static const char* sAnisotropyAttribute = "anisotropy";
+
+struct PartioRelease {
+    void operator()(Partio::ParticlesDataMutable* data) const { data->release(); }
+};
+
+struct Frame {
+    int                                                          index = 0;
+    std::unique_ptr<Partio::ParticlesDataMutable, PartioRelease> data;
+    ParticleArrays<ParticleReal, 3>                              positions;
+    std::vector<int>                                             ids;       // none without an id
+    std::vector<Eigen::Vector3d>                                 surface;   // triangles
+};
+
+/// busy time of one pipeline stage
+struct StageClock {
+    double seconds = 0.0;
+
+    template<typename Fn> auto Time(Fn&& fn) {
+        auto start  = std::chrono::steady_clock::now();
+        auto result = fn();
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+};
+
+/// the first "%d" or "%0Nd" in pattern replaced by frame, patterns without one name a single file
+static std::string sFramePath(const std::string& pattern, int frame) {
+    auto percent = pattern.find('%');
+    if (percent == std::string::npos)
+        return pattern;
+    size_t end   = percent + 1;
+    int    width = 0;
+    while (end < pattern.size() && std::isdigit((unsigned char)pattern[end])) {
+        width = 10 * width + (pattern[end++] - '0');
+    }
+    if (end == pattern.size() || pattern[end] != 'd')
+        return pattern;
+    return pattern.substr(0, percent) + fmt::format("{:0{}d}", frame, width) +
+           pattern.substr(end + 1);
+}
+
+static bool sReadFrame(const std::string& path, Frame& frame) {
+    std::stringstream errStream;
+    frame.data.reset(Partio::read(path.c_str(), false, errStream));
+    if (!frame.data) {
+        spdlog::error("File not open: {} {}", path, errStream.str());
+        return false;
+    }
+    // ids track particles across frames for the Verlet skin
+    Partio::ParticleAttribute idAttr;
+    frame.ids.clear();
+    if (frame.data->attributeInfo("id", idAttr) && idAttr.type == Partio::INT) {
+        frame.ids.resize(frame.data->numParticles());
+        for (int i = 0; i < frame.data->numParticles(); i++) {
+            frame.ids[i] = *frame.data->data<int>(idAttr, i);
+        }
+    }
+    return frame.positions.Load(*frame.data);
+}
+
+static void sWriteKernels(Partio::ParticlesDataMutable& data, const Anisotropy<3>& anisotropy) {
+    Partio::ParticleAttribute attr;
+    if (!data.attributeInfo(sAnisotropyAttribute, attr)) {
+        attr = data.addAttribute(sAnisotropyAttribute, Partio::FLOAT, 9);
+    }
+    for (int i = 0; i < anisotropy.Size(); i++) {
+        float*                 g = data.dataWrite<float>(attr, i);
+        const Eigen::Matrix3d& G = anisotropy.Kernel(i);
+        for (int k = 0; k < 9; k++) {
+            g[k] = (float)G(k / 3, k % 3);
+        }
+    }
+}
+
+static bool sWriteFrame(const std::string& path, const Frame& frame) {
+    std::stringstream errStream;
+    // errors only reach errStream with verbose on
+    Partio::write(path.c_str(), *frame.data, false, true, errStream);
+    if (!errStream.str().empty()) {
+        spdlog::error("Write failed: {} {}", path, errStream.str());
+        return false;
+    }
+    return true;
+}
+
+/// triangle soup as OBJ, the vertices of face k are 3k + 1 to 3k + 3
+static bool sWriteSurface(const std::string& path, const std::vector<Eigen::Vector3d>& triangles) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        spdlog::error("File not open: {}", path);
+        return false;
+    }
+    fmt::memory_buffer buffer;
+    for (const auto& v : triangles) {
+        fmt::format_to(std::back_inserter(buffer), "v {} {} {}\n", (float)v.x(), (float)v.y(), (float)v.z());
+    }
+    for (size_t k = 0; k < triangles.size(); k += 3) {
+        fmt::format_to(std::back_inserter(buffer), "f {} {} {}\n", k + 1, k + 2, k + 3);
+    }
+    out.write(buffer.data(), (std::streamsize)buffer.size());
+    return out.good();
+}
+
+/// fast and deterministic mode on the same frame, best of runs for every pass: what reproducible
+/// kernels cost on this data
+static int
+sBenchmark(const std::string& path, const AnisotropyParams& params, bool morton, int runs) {
+    Frame frame;
+    if (!sReadFrame(path, frame))
+        return -1;
+    const int*               ids = frame.ids.empty() ? nullptr : frame.ids.data();
+    Anisotropy<3>::PassTimes best[2];
+    double                   total[2] = {1e30, 1e30};
+    for (int mode = 0; mode < 2; mode++) {
+        Anisotropy<3> anisotropy;
+        anisotropy.SetLogPasses(false);
+        anisotropy.SetMortonOrder(morton);
+        anisotropy.SetDeterministic(mode == 1);
+        for (int run = 0; run < runs; run++) {
+            auto start = std::chrono::steady_clock::now();
+            anisotropy.Compute(frame.positions, params, ids);
+            total[mode] = std::min(
+                total[mode],
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            const auto& passes = anisotropy.PassSeconds();
+            if (run == 0) {
+                best[mode] = passes;
+            }
+            for (size_t p = 0; p < passes.size(); p++) {
+                best[mode][p].second = std::min(best[mode][p].second, passes[p].second);
+            }
+        }
+    }
+    spdlog::info("{} particles, best of {} runs on {} threads",
+                 frame.positions.Size(),
+                 runs,
+                 gThreadPool.ThreadCount());
+    spdlog::info("{:<16} {:>10} {:>17} {:>10}", "pass", "fast ms", "deterministic ms", "overhead");
+    // the deterministic passes are the fast ones plus the neighbor order
+    for (const auto& [name, seconds] : best[1]) {
+        auto fast = std::find_if(best[0].begin(), best[0].end(), [&](const auto& pass) {
+            return pass.first == name;
+        });
+        if (fast == best[0].end()) {
+            spdlog::info("{:<16} {:>10} {:>17.2f} {:>10}", name, "-", 1000.0 * seconds, "new");
+        } else {
+            spdlog::info("{:<16} {:>10.2f} {:>17.2f} {:>9.0f}%",
+                         name,
+                         1000.0 * fast->second,
+                         1000.0 * seconds,
+                         100.0 * (seconds / fast->second - 1.0));
+        }
+    }
+    spdlog::info("{:<16} {:>10.2f} {:>17.2f} {:>9.0f}%",
+                 "total",
+                 1000.0 * total[0],
+                 1000.0 * total[1],
+                 100.0 * (total[1] / total[0] - 1.0));
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    spdlog::set_level(spdlog::level::info);
+    std::string      input, output, surface;
+    SurfaceParams    surfaceParams;
+    AnisotropyParams params;
+    params.h       = 0.0;
+    int    first         = 0;
+    int    last          = 0;
+    int    threads       = 0;
+    bool   logPasses     = false;
+    bool   morton        = true;
+    bool   deterministic = false;
+    double skin          = 0.0;
+    int    benchmark     = 0;
+    if (argc % 2 != 1) {
+        spdlog::error("Flag not correct!");
+        return -1;
+    }
+    // flags come in pairs: aniso in <in_%d.bgeo> out <out_%d.bgeo> h <h> [kr <kr>] [kn <kn>]
+    //                            [nEps <n>] [k <n>] [kernel cubic|poly6|spline|wendland]
+    //                            [first <frame>] [last <frame>] [threads <n>]
+    //                            [passes on|off] [morton on|off] [deterministic on|off] [skin <s>]
+    //                            [benchmark <runs>]
+    //                            [surface <mesh_%d.obj>] [iso <level>] [spacing <s>]
+    for (int i = 1; i < argc; i += 2) {
+        std::string flagName = argv[i];
+        std::string value    = argv[i + 1];
+        if (flagName == "in") {
+            input = value;
+        } else if (flagName == "out") {
+            output = value;
+        } else if (flagName == "h") {
+            params.h = std::atof(value.c_str());
+        } else if (flagName == "kr") {
+            params.kr = std::atof(value.c_str());
+        } else if (flagName == "kn") {
+            params.kn = std::atof(value.c_str());
+        } else if (flagName == "nEps") {
+            params.nEps = std::atoi(value.c_str());
+        } else if (flagName == "k") {
+            params.k = std::atoi(value.c_str());
+            // the support reaches the k-th other particle, one alone gives no covariance
+            if (params.k != 0 && params.k < 2) {
+                spdlog::error("k needs at least 2 neighbors, 0 turns it off: {}", value);
+                return -1;
+            }
+        } else if (flagName == "kernel") {
+            if (!sParseKernel(value, params.kernel)) {
+                spdlog::error("Unknown kernel {}, one of cubic poly6 spline wendland", value);
+                return -1;
+            }
+        } else if (flagName == "first") {
+            first = std::atoi(value.c_str());
+        } else if (flagName == "last") {
+            last = std::atoi(value.c_str());
+        } else if (flagName == "threads") {
+            threads = std::atoi(value.c_str());
+        } else if (flagName == "passes" && (value == "on" || value == "off")) {
+            logPasses = value == "on";
+        } else if (flagName == "morton" && (value == "on" || value == "off")) {
+            morton = value == "on";
+        } else if (flagName == "deterministic" && (value == "on" || value == "off")) {
+            deterministic = value == "on";
+        } else if (flagName == "benchmark") {
+            benchmark = std::atoi(value.c_str());
+        } else if (flagName == "skin") {
+            skin = std::atof(value.c_str());
+        } else if (flagName == "surface") {
+            surface = value;
+        } else if (flagName == "iso") {
+            surfaceParams.iso = std::atof(value.c_str());
+        } else if (flagName == "spacing") {
+            surfaceParams.spacing = std::atof(value.c_str());
+        } else {
+            spdlog::error("Flag not correct: {} {}", flagName, value);
+            return -1;
+        }
+    }
+    if (input.empty() || (output.empty() && benchmark <= 0) || !(params.h > 0.0)) {
+        spdlog::error("aniso needs in <file>, out <file> (or benchmark <runs>) and a positive h");
+        return -1;
+    }
+    // RealFlow .bin has a fixed set of fields, the kernels would be dropped silently
+    auto extension = output.substr(output.rfind('.') + 1);
+    if (extension == "bin" || (extension == "gz" && output.find(".bin.") != std::string::npos)) {
+        spdlog::error(
+            "{} cannot carry the {} attribute, write bgeo instead", output, sAnisotropyAttribute);
+        return -1;
+    }
+    // a pattern gives every frame its own path
+    auto isSequence = [](const std::string& pattern) {
+        return sFramePath(pattern, 0) != sFramePath(pattern, 1);
+    };
+    if (!isSequence(input)) {
+        last = first;
+    }
+    if (last < first) {
+        spdlog::error("last {} is before first {}, no frame to process", last, first);
+        return -1;
+    }
+    if (last > first) {
+        for (const auto& pattern : {output, surface}) {
+            if (!pattern.empty() && !isSequence(pattern)) {
+                spdlog::error("{} has no %d, every frame would overwrite it", pattern);
+                return -1;
+            }
+        }
+    }
+    if (!(surfaceParams.spacing > 0.0)) {
+        surfaceParams.spacing = 0.5 * params.h;
+    }
+    gThreadPool.SetThreadCount(threads);
+    if (benchmark > 0) {
+        return sBenchmark(sFramePath(input, first), params, morton, benchmark);
+    }
+
+    // reader -> compute (here, on gThreadPool) -> writer, two frames in flight between stages
+    BoundedQueue<Frame> readFrames(2);
+    BoundedQueue<Frame> doneFrames(2);
+    StageClock          readClock, computeClock, writeClock;
+    int                 failed = 0;
+    auto                start  = std::chrono::steady_clock::now();
+
+    std::thread reader([&]() {
+        for (int f = first; f <= last; f++) {
+            Frame frame;
+            frame.index = f;
+            if (!readClock.Time([&]() { return sReadFrame(sFramePath(input, f), frame); })) {
+                failed++;
+                continue;
+            }
+            if (!readFrames.Push(std::move(frame)))
+                break;
+        }
+        readFrames.Close();
+    });
+    int         written = 0;
+    std::thread writer([&]() {
+        Frame frame;
+        while (doneFrames.Pop(frame)) {
+            if (writeClock.Time([&]() {
+                    return sWriteFrame(sFramePath(output, frame.index), frame) &&
+                           (surface.empty() ||
+                            sWriteSurface(sFramePath(surface, frame.index), frame.surface));
+                })) {
+                written++;
+            }
+            frame.data.reset();
+            frame.surface = {};
+        }
+    });
+
+    long long     particles = 0;
+    int           frames    = 0;
+    Anisotropy<3> anisotropy;
+    anisotropy.SetLogPasses(logPasses);
+    anisotropy.SetMortonOrder(morton);
+    anisotropy.SetDeterministic(deterministic);
+    anisotropy.SetVerletSkin(skin);
+    int reused = 0;
+    Isosurface<3> isosurface;
+    isosurface.SetLogPasses(logPasses);
+    std::vector<Eigen::Vector3d> centers;
+    Frame frame;
+    while (readFrames.Pop(frame)) {
+        computeClock.Time([&]() {
+            anisotropy.Compute(
+                frame.positions, params, frame.ids.empty() ? nullptr : frame.ids.data());
+            reused += anisotropy.VerletReused();
+            sWriteKernels(*frame.data, anisotropy);
+            if (!surface.empty()) {
+                centers.resize(frame.positions.Size());
+                for (int i = 0; i < frame.positions.Size(); i++) {
+                    centers[i] = frame.positions.Position(i);
+                }
+                isosurface.Splat(centers, anisotropy.Kernels(), surfaceParams.spacing);
+                isosurface.Extract(surfaceParams.iso);
+                frame.surface = isosurface.Vertices();
+            }
+            return true;
+        });
+        spdlog::info("frame {}: {} particles", frame.index, frame.positions.Size());
+        particles += (long long)frame.positions.Size();
+        frames++;
+        frame.positions = {};
+        frame.ids       = {};
+        doneFrames.Push(std::move(frame));
+    }
+    doneFrames.Close();
+    reader.join();
+    writer.join();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    spdlog::info("{} frames, {} particles in {:.2f} s: {:.2f} frames/s, {:.2f} M particles/s",
+                 frames,
+                 particles,
+                 seconds,
+                 seconds > 0.0 ? frames / seconds : 0.0,
+                 seconds > 0.0 ? (double)particles / seconds * 1e-6 : 0.0);
+    spdlog::info("busy: read {:.2f} s, compute {:.2f} s, write {:.2f} s on {} threads",
+                 readClock.seconds,
+                 computeClock.seconds,
+                 writeClock.seconds,
+                 gThreadPool.ThreadCount());
+    if (skin > 0.0) {
+        spdlog::info("neighbor candidates reused on {} of {} frames", reused, frames);
+    }
+    if (failed > 0 || written != frames) {
+        spdlog::error("{} frames not read, {} not written", failed, frames - written);
+        return -1;
+    }
+    return 0;
+}
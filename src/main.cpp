@@ -9,14 +9,101 @@
 #include "imgui_impl_opengl3.h"
 #include "HybridDraw.h"
 #include "HierarchyCallStack.h"
+#include "CallStackTail.h"
+#include "FramePacer.h"
+#include "Profiler.h"
 #include <spdlog/spdlog.h>
+#include <filesystem>
 
 
 
 std::vector<ImFont*> gFonts(30, nullptr);
 GLFWwindow*          gMainWindow   = nullptr;
+FramePacer           gFramePacer;
 static float         sDisplayScale = 1.f;
 
+/// Idle: block in glfwWaitEventsTimeout and only render after input, resize or a change of the
+/// description file. Continuous: the old behaviour, re-render at 60Hz.
+enum class RedrawMode { Idle, Continuous };
+
+static RedrawMode   sRedrawMode         = RedrawMode::Idle;
+static int          sDirtyFrames        = 1;
+static const double sFileWatchInterval  = 0.25;   // seconds between two checks of the file
+static const double sFollowInterval     = 1.0 / 60.0;   // same, when following a growing file
+
+/// follow mode: the file is a growing log, only appended lines are parsed
+static bool sFollowMode = false;
+static bool sFollowEnd  = true;   // keep the newest row in view
+
+static void sRequestRedraw() {
+    // ImGui resolves hover/active state one frame after the input event, so draw twice
+    sDirtyFrames = 2;
+}
+
+static void sMouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+    ImGui_ImplGlfw_MouseButtonCallback(window, button, action, mods);
+    sRequestRedraw();
+}
+
+static void sScrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
+    ImGui_ImplGlfw_ScrollCallback(window, xoffset, yoffset);
+    sRequestRedraw();
+}
+
+static void sKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    ImGui_ImplGlfw_KeyCallback(window, key, scancode, action, mods);
+    if (key == GLFW_KEY_F2 && action == GLFW_PRESS) {
+        gProfiler.mShowOverlay = !gProfiler.mShowOverlay;
+    }
+    sRequestRedraw();
+}
+
+static void sCharCallback(GLFWwindow* window, unsigned int c) {
+    ImGui_ImplGlfw_CharCallback(window, c);
+    sRequestRedraw();
+}
+
+static void sCursorPosCallback(GLFWwindow*, double, double) { sRequestRedraw(); }
+static void sFramebufferSizeCallback(GLFWwindow*, int, int) { sRequestRedraw(); }
+static void sWindowRefreshCallback(GLFWwindow*) { sRequestRedraw(); }
+static void sWindowFocusCallback(GLFWwindow*, int) { sRequestRedraw(); }
+
+static void sInstallCallbacks(GLFWwindow* window) {
+    // ImGui is initialized without its own callbacks, forward the events from here
+    glfwSetMouseButtonCallback(window, sMouseButtonCallback);
+    glfwSetScrollCallback(window, sScrollCallback);
+    glfwSetKeyCallback(window, sKeyCallback);
+    glfwSetCharCallback(window, sCharCallback);
+    glfwSetCursorPosCallback(window, sCursorPosCallback);
+    glfwSetFramebufferSizeCallback(window, sFramebufferSizeCallback);
+    glfwSetWindowRefreshCallback(window, sWindowRefreshCallback);
+    glfwSetWindowFocusCallback(window, sWindowFocusCallback);
+}
+
+enum class InputFormat { Txt, ChromeTrace, FoldedStacks };
+
+static void sReadCallStack(HierarchyCallStack& cs, const std::string& file, InputFormat format,
+                           CallStackLayout layout) {
+    switch (format) {
+    case InputFormat::Txt:
+        cs.ReadTxt(file);
+        // importers merge frames already
+        if (layout == CallStackLayout::FlameGraph) {
+            cs.Aggregate();
+        }
+        break;
+    case InputFormat::ChromeTrace: cs.ReadChromeTrace(file); break;
+    case InputFormat::FoldedStacks: cs.ReadFoldedStacks(file); break;
+    }
+    cs.BuildSearchIndex();
+}
+
+static std::filesystem::file_time_type sFileWriteTime(const std::string& file) {
+    std::error_code ec;
+    auto            time = std::filesystem::last_write_time(file, ec);
+    return ec ? std::filesystem::file_time_type::min() : time;
+}
+
 static void sCreateUI(GLFWwindow* window, const char* glslVersion = nullptr) {
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -45,17 +132,90 @@ static void sCreateUI(GLFWwindow* window, const char* glslVersion = nullptr) {
     }
 }
 
-static void UpdateUI() {}
+static char         sSearchQuery[256] = "";
+static bool         sSearchRegex      = false;
+static SearchResult sSearchResult;
+static int          sSearchCurrent = -1;
+
+static void sRunSearch(HierarchyCallStack& cs, CallStackLayout layout) {
+    sSearchResult  = cs.Search(sSearchQuery, sSearchRegex);
+    sSearchCurrent = sSearchResult.first;
+    cs.Focus(sSearchCurrent, layout);
+}
+
+static void UpdateUI(HierarchyCallStack& cs, CallStackLayout layout) {
+    ImGui::SetNextWindowPos(ImVec2(float(gCamera.mWidth) - 330.f, 10.f), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.8f);
+    ImGui::Begin("Search", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+    bool changed = ImGui::InputText("##query", sSearchQuery, sizeof(sSearchQuery));
+    ImGui::SameLine();
+    changed |= ImGui::Checkbox("regex prefix", &sSearchRegex);
+    if (changed) {
+        sRunSearch(cs, layout);
+    }
+    if (sSearchQuery[0] != '\0') {
+        ImGui::Text("%d names, %d frames (%.3f ms)",
+                    sSearchResult.names,
+                    sSearchResult.hits,
+                    sSearchResult.milliseconds);
+        ImGui::SameLine();
+        if (ImGui::Button("Next") && sSearchResult.hits > 0) {
+            sSearchCurrent = cs.NextHit(sSearchCurrent);
+            cs.Focus(sSearchCurrent, layout);
+            sFollowEnd = false;
+        }
+    }
+    if (sFollowMode) {
+        ImGui::Checkbox("follow end", &sFollowEnd);
+        ImGui::SameLine();
+        ImGui::Text("%d frames", cs.FuncCount());
+    }
+    ImGui::End();
+}
 
 int main(int argc, char* argv[]) {
     std::string txtName = "codegraph";
-    if (argc != 3 && argc != 1){
+    std::string file;
+    InputFormat format  = InputFormat::Txt;
+    auto        layout  = CallStackLayout::List;
+    bool        vsync   = false;
+    bool        profile = false;
+    if (argc % 2 != 1) {
         spdlog::error("Flag not correct!");
         return -1;
     }
-    if (argc == 3){
-        std::string flagName = argv[1];
-        txtName = argv[2];
+    // flags come in pairs: main [file <name>] [redraw idle|continuous] [vsync on|off]
+    //                           [profile <trace.json>] [chrome <trace.json>] [folded <stacks.txt>]
+    //                           [layout list|flame] [follow <growing.txt>]
+    for (int i = 1; i < argc; i += 2) {
+        std::string flagName = argv[i];
+        std::string value    = argv[i + 1];
+        if (flagName == "file") {
+            txtName = value;
+        } else if (flagName == "follow") {
+            file        = value;
+            format      = InputFormat::Txt;
+            sFollowMode = true;
+        } else if (flagName == "chrome" || flagName == "folded") {
+            file   = value;
+            format = flagName == "chrome" ? InputFormat::ChromeTrace : InputFormat::FoldedStacks;
+        } else if (flagName == "redraw" && (value == "idle" || value == "continuous")) {
+            sRedrawMode = value == "idle" ? RedrawMode::Idle : RedrawMode::Continuous;
+        } else if (flagName == "vsync" && (value == "on" || value == "off")) {
+            vsync = value == "on";
+        } else if (flagName == "layout" && (value == "list" || value == "flame")) {
+            layout = value == "list" ? CallStackLayout::List : CallStackLayout::FlameGraph;
+        } else if (flagName == "profile") {
+            gProfiler.mTracePath = value;
+            profile              = true;
+        } else {
+            spdlog::error("Flag not correct: {} {}", flagName, value);
+            return -1;
+        }
+    }
+    if (sFollowMode && (format != InputFormat::Txt || layout != CallStackLayout::List)) {
+        spdlog::error("follow only supports txt files in the list layout");
+        return -1;
     }
     spdlog::set_level(spdlog::level::info);
 
@@ -88,6 +248,7 @@ int main(int argc, char* argv[]) {
 
     glfwGetWindowContentScale(gMainWindow, &sDisplayScale, &sDisplayScale);
     glfwMakeContextCurrent(gMainWindow);
+    gFramePacer.SetVsync(vsync);
 
     int version = gladLoadGL(glfwGetProcAddress);
     printf("GL %d.%d\n", GLAD_VERSION_MAJOR(version), GLAD_VERSION_MINOR(version));
@@ -97,17 +258,67 @@ int main(int argc, char* argv[]) {
     gDraw.Create();
 
     sCreateUI(gMainWindow, glslVersion);
+    sInstallCallbacks(gMainWindow);
 
     glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
     glDisable(GL_DEPTH_TEST);
 
 
-    std::chrono::duration<double> frameTime(0.0);
-    std::chrono::duration<double> sleepAdjust(0.0);
+
+    if (file.empty()) {
+        file = std::string(CURRENT_PROJECT_PATH) + "resources/" + txtName + ".txt";
+    }
+    auto               fileWriteTime = sFileWriteTime(file);
+    HierarchyCallStack cs;
+    CallStackTail      tail(file);
+    if (sFollowMode) {
+        // the whole file comes in through the tail, a chunk per frame
+        cs.BuildSearchIndex();
+    } else {
+        sReadCallStack(cs, file, format, layout);
+    }
 
 
     while (!glfwWindowShouldClose(gMainWindow)) {
-        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        if (sRedrawMode == RedrawMode::Idle && sDirtyFrames == 0) {
+            // nothing to draw: sleep until an event arrives or it is time to look at the file
+            glfwWaitEventsTimeout(sFollowMode ? sFollowInterval : sFileWatchInterval);
+        } else {
+            glfwPollEvents();
+        }
+
+        if (sFollowMode) {
+            auto status = tail.Poll(cs);
+            if (status == CallStackTail::Status::Truncated) {
+                cs = HierarchyCallStack();
+                cs.BuildSearchIndex();
+                cs.Search(sSearchQuery, sSearchRegex);
+                status = tail.Poll(cs);
+            }
+            if (status == CallStackTail::Status::Appended) {
+                sSearchResult = cs.LastSearch();
+                if (sFollowEnd) {
+                    cs.Focus(cs.FuncCount() - 1, layout);
+                }
+                sRequestRedraw();
+            }
+        } else if (auto writeTime = sFileWriteTime(file); writeTime != fileWriteTime) {
+            fileWriteTime = writeTime;
+            cs            = HierarchyCallStack();
+            sReadCallStack(cs, file, format, layout);
+            sSearchResult = cs.Search(sSearchQuery, sSearchRegex);
+            sRequestRedraw();
+        }
+
+        if (sRedrawMode == RedrawMode::Idle) {
+            if (sDirtyFrames == 0) {
+                continue;
+            }
+            sDirtyFrames--;
+        }
+
+        gFramePacer.BeginFrame();
+        gProfiler.BeginFrame();
 
         glfwGetWindowSize(gMainWindow, &gCamera.mWidth, &gCamera.mHeight);
         spdlog::debug("width {}  height {}", gCamera.mWidth, gCamera.mHeight);
@@ -133,7 +344,11 @@ int main(int argc, char* argv[]) {
         ImGui::End();
 
 
-        UpdateUI();
+        UpdateUI(cs, layout);
+        // zooming far out is what switches the list to the LOD bands of the RowPyramid
+        if (gCamera.UpdateFromMouse()) {
+            sRequestRedraw();
+        }
 
         if (false) {
             sDrawRectText({50, 700}, "static void sDrawRectText(const Vec2& p, ...)");
@@ -142,47 +357,44 @@ int main(int argc, char* argv[]) {
         }
 
         if (true) {
-            auto file = std::string(CURRENT_PROJECT_PATH) + "resources/" + txtName + ".txt";
-            HierarchyCallStack cs;
-            cs.ReadTxt(file);
-            cs.Draw();
+            cs.Draw(layout);
         }
 
         if (true) {
             static std::string buffer;
-            buffer = std::to_string(1000.0 * frameTime.count()) + " ms.";
+            buffer = fmt::format("{:.2f} ms. p50 {:.2f} p99 {:.2f}",
+                                 1000.0 * gFramePacer.FrameTime().count(),
+                                 1000.0 * gFramePacer.Percentile(50),
+                                 1000.0 * gFramePacer.Percentile(99));
             gDraw.DrawString(Vec2{1350, 800}, buffer, 8.f);
         }
 
+        gProfiler.DrawOverlay();
 
-
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-
-
-        glfwSwapBuffers(gMainWindow);
-        glfwPollEvents();
-
-        // Throttle to cap at 60Hz. This adaptive using a sleep adjustment. This could be improved
-        // by using mm_pause or equivalent for the last millisecond.
-        std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
-        std::chrono::duration<double>         target(1.0 / 60.0);
-        std::chrono::duration<double>         timeUsed  = t2 - t1;
-        std::chrono::duration<double>         sleepTime = target - timeUsed + sleepAdjust;
-        if (sleepTime > std::chrono::duration<double>(0)) {
-            std::this_thread::sleep_for(sleepTime);
+        {
+            PROFILE_SCOPE("ImGui");
+            PROFILE_GPU_SCOPE("ImGui");
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         }
-        std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
-        frameTime                                = t3 - t1;
-        spdlog::debug("SleepTime: {} ms,  frameTime: {} ms",
-                      1000.0 * sleepTime.count(),
-                      1000.0 * frameTime.count());
 
+        {
+            PROFILE_SCOPE("Swap");
+            glfwSwapBuffers(gMainWindow);
+        }
+        gProfiler.EndFrame();
 
-        // Compute the sleep adjustment using a low pass filter
-        sleepAdjust = 0.9 * sleepAdjust + 0.1 * (target - frameTime);
+        // Cap at 60Hz: sleep until ~1ms before the deadline, then spin for the rest (or vsync)
+        gFramePacer.EndFrame();
+        spdlog::debug("frameTime: {} ms", 1000.0 * gFramePacer.FrameTime().count());
     }
 
+    if (profile) {
+        gProfiler.ExportChromeTrace(gProfiler.mTracePath);
+    }
+    gProfiler.Destroy();
+    // release the retained buffers while the context is alive
+    cs = HierarchyCallStack();
     gDraw.Destroy();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -11,6 +11,10 @@
 #include "imgui_impl_opengl3.h"
 
 #include "Draw.h"
+#include "FramePacer.h"
+#include "Profiler.h"
+#include "Anisotropy.h"
+#include "Isosurface.h"
 #include <spdlog/spdlog.h>
 #include <Eigen/Dense>
 #include <partio/src/lib/Partio.h>
@@ -19,147 +23,145 @@
 using TV = Eigen::Vector2d;
 using TM = Eigen::Matrix2d;
 
-std::vector<TV> gParticles;
+ParticleArrays<ParticleReal, 2> gParticles;
+static PointBuffer              sPoints;   // gParticles on the GPU
+
+// cache positions to world space
+static const Vec2 sCacheScale{100.f, 100.f};
+static const Vec2 sCacheOffset{0.f, -600.f};
 
 void sReadParticles() {
     const char*       filename = "/Users/wangchenhui/Downloads/particlesInfos_21.bgeo";
     std::stringstream errStream;
     auto              particlesData = Partio::readBGEO(filename, false, &errStream);
+    if (!particlesData) {
+        spdlog::error("File not open: {} {}", filename, errStream.str());
+        return;
+    }
 
-    int                       num = particlesData->numParticles();
-    Partio::ParticleAttribute positionAttr;
-    bool        positionFound = particlesData->attributeInfo("position", positionAttr);
-    const auto* positions     = particlesData->data<float>(positionAttr, 0);
-    for (int i = 0; i < 6527; i++) {
-        gParticles.push_back(100.0 * TV{positions[3 * i], positions[3 * i + 1] - 6.0});
+    // x and y of the 3D positions, straight from the attribute buffer. The GPU gets the buffer
+    // as it is in one copy and applies the transform in the vertex shader.
+    const float* first;
+    int          stride;
+    if (sFloatAttribute(*particlesData, "position", 2, first, stride)) {
+        gParticles.Load(first, particlesData->numParticles(), stride);
+        gParticles.Transform(TV(sCacheScale.x, sCacheScale.y), TV(sCacheOffset.x, sCacheOffset.y));
+        sPoints.Upload(first, particlesData->numParticles(), stride, sCacheScale, sCacheOffset);
     }
     particlesData->release();
 }
 
 
-void sDrawSphParticles() {
-    // generate particles
-
-    double           h = 25;
-    double           r = 2 * h;
-    double  radius = 5;
-
-    if (gParticles.empty()) {
-
+// The anisotropic kernels are computed once and cached with their ellipses in a LineBuffer, they
+// are only recomputed when the particles or the parameters change. Every frame redraws the cache,
+// so panning, zooming and resizing cost no more than the draw calls.
+static AnisotropyParams sParams;                  // edited in the UI
+static AnisotropyParams sComputedParams;          // the ones sAnisotropy was computed with
+static int              sParticlesVersion = 0;    // bumped whenever gParticles changes
+static int              sComputedVersion  = -1;
+static Anisotropy<2>    sAnisotropy;
+static LineBuffer       sEllipses;
+static SurfaceParams    sSurfaceParams;           // edited in the UI, spacing 0 follows h
+static SurfaceParams    sComputedSurfaceParams;
+static Isosurface<2>    sSurface;
+static LineBuffer       sSurfaceLines;            // the contour of the fluid
+static double           sRadius = 5;
+
+static void sLoadParticles() {
 #define bunny
 #ifdef bunny
-        sReadParticles();
+    sReadParticles();
+    sParams.h = 25;
+    sRadius   = 5;
 #else
-
-            for (int i = 300; i < 1000; i += 20) {
-                for (int j = 50; j < 750; j += 20) {
-                    gParticles.emplace_back(i, j);
-                }
-            }
-            h = 50;
-            r = 2 * h;
-            radius = 8;
-#endif
-    }
-    // draw points
-    std::for_each(gParticles.begin(), gParticles.end(), [](const TV& v) {
-        gDraw.DrawPoint({v.x(), v.y()}, Vec4(174, 107, 129, 255) / 255.f, 3);
-    });
-//    return;
-
-    int n = gParticles.size();
-
-    // anistropic kernel
-    // x_weight
-
-
-    std::vector<int> Nei(n, 0);
-    std::vector<TV>  x_w(n, TV::Zero());
-    auto&            X = gParticles;
-    for (int i = 0; i < n; i++) {
-        spdlog::info("x_weight: {}", i);
-        double w_ij_total = 0.0;
-        for (int j = 0; j < n; j++) {
-            auto x_ij = X[i] - X[j];
-            if (x_ij.norm() < r) {
-                double w_ij = 1 - (x_ij.norm() / r) * (x_ij.norm() / r) * (x_ij.norm() / r);
-                x_w[i] += w_ij * X[j];
-                w_ij_total += w_ij;
-                Nei[i]++;
-            }
+    gParticles.Resize(35 * 35);
+    for (int i = 300, k = 0; i < 1000; i += 20) {
+        for (int j = 50; j < 750; j += 20) {
+            gParticles.SetPosition(k++, TV(i, j));
         }
-        x_w[i] /= w_ij_total;
     }
-
-    // C
-    double kr = 4;
-    //    double ks    = 1;
-    double kn    = 0.5;
-    int    N_eps = 20;
-
-    std::vector<double> ks(n);
-    std::vector<TM>     C(n, TM::Zero());
-    for (int i = 0; i < n; i++) {
-        spdlog::info("C: {}", i);
-        double w_ij_total = 0.0;
-        for (int j = 0; j < n; j++) {
-            auto x_ij = X[i] - X[j];
-            if (x_ij.norm() < r) {
-                double w_ij = 1 - (x_ij.norm() / r) * (x_ij.norm() / r) * (x_ij.norm() / r);
-                C[i] += w_ij * (X[j] - x_w[i]) * (X[j] - x_w[i]).transpose();
-                w_ij_total += w_ij;
-            }
-        }
-        C[i] /= w_ij_total;
-
-        ks[i] = sqrt(1.0 / C[i].determinant());
-        C[i] *= ks[i];
-
-        if (Nei[i] < N_eps) {
-            C[i] = 0.5 * TM::Identity();
-        }
+    std::vector<float> xy(2 * gParticles.Size());
+    for (int i = 0; i < gParticles.Size(); i++) {
+        xy[2 * i]     = (float)gParticles.Axis(0)[i];
+        xy[2 * i + 1] = (float)gParticles.Axis(1)[i];
     }
+    sPoints.Upload(xy.data(), gParticles.Size(), 2);
+    sParams.h = 50;
+    sRadius   = 8;
+#endif
+    sParticlesVersion++;
+}
 
-    // SVD
-
-    std::vector<TM> Rotate(n);
-    std::vector<TV> Scale(n);
-    for (int i = 0; i < n; i++) {
-        spdlog::info("SVD: {}", i);
-        Eigen::JacobiSVD<Eigen::MatrixXd> svd(C[i], Eigen::ComputeThinU | Eigen::ComputeThinV);
-        TM                                R     = svd.matrixU();
-        TM                                Sigma = svd.singularValues().asDiagonal();
-        Rotate[i]                               = R;
-        double s0                               = Sigma(0, 0);
-        double s1                               = Sigma(1, 1);
-        spdlog::info("{}  {}", s0, s1);
-        //        s1  = std::max(s1, s0 / kr);
-        Scale[i] = {s0, s1};
+static void sAddEllipse(LineBuffer& lines, const TV& center, double radius, const Vec4& color,
+                        const TV& scale, const TM& rotate) {
+    const int segment = 36;
+    TM        axes    = rotate * scale.asDiagonal() * radius;
+    for (int i = 0; i < segment; i++) {
+        double alpha0 = 2.0 * M_PI * i / segment;
+        double alpha1 = 2.0 * M_PI * (i + 1) / segment;
+        TV     x0     = center + axes * TV{std::cos(alpha0), std::sin(alpha0)};
+        TV     x1     = center + axes * TV{std::cos(alpha1), std::sin(alpha1)};
+        lines.AddLine({x0.x(), x0.y()}, {x1.x(), x1.y()}, color);
     }
+}
 
+/// the contour where the density of the kernels crosses the iso level
+static void sUpdateSurface() {
+    double spacing = sSurfaceParams.spacing > 0.0 ? sSurfaceParams.spacing : 0.5 * sParams.h;
+    std::vector<TV> centers(gParticles.Size());
+    for (int i = 0; i < gParticles.Size(); i++) {
+        centers[i] = gParticles.Position(i);
+    }
+    sSurface.Splat(centers, sAnisotropy.Kernels(), spacing);
+    sSurface.Extract(sSurfaceParams.iso);
+    sComputedSurfaceParams = sSurfaceParams;
+
+    sSurfaceLines.Clear();
+    const auto& vertices = sSurface.Vertices();
+    for (size_t k = 0; k + 1 < vertices.size(); k += 2) {
+        sSurfaceLines.AddLine({vertices[k].x(), vertices[k].y()},
+                              {vertices[k + 1].x(), vertices[k + 1].y()},
+                              Vec4(90, 160, 230, 255) / 255.f);
+    }
+}
 
-
-
-
-
-    // draw spheres
-    for (int i = 0; i < n; i++) {
-        gDraw.DrawCircle({gParticles[i].x(), gParticles[i].y()},
-                         radius,
-                         Vec4(241, 239, 236, 255) / 255.f,
-                         Scale[i],
-                         Rotate[i]);
+/// compute stage: recompute the kernels and rebuild the ellipses and the surface if anything they
+/// depend on changed
+static void sUpdateAnisotropy() {
+    if (sComputedVersion == sParticlesVersion && sComputedParams == sParams) {
+        if (sComputedSurfaceParams != sSurfaceParams) {
+            sUpdateSurface();
+        }
+        return;
     }
+    sAnisotropy.Compute(gParticles, sParams);
+    sComputedParams  = sParams;
+    sComputedVersion = sParticlesVersion;
+
+    sEllipses.Clear();
+    for (int i = 0; i < sAnisotropy.Size(); i++) {
+        sAddEllipse(sEllipses,
+                    gParticles.Position(i),
+                    sRadius,
+                    Vec4(241, 239, 236, 255) / 255.f,
+                    sAnisotropy.Scale(i),
+                    sAnisotropy.Rotate(i));
+    }
+    sUpdateSurface();
+}
 
+/// render stage, every frame from the cache
+static void sDrawSphParticles() {
+    sPoints.SetStyle(Vec4(174, 107, 129, 255) / 255.f, 3);
+    sPoints.Flush();
     gDraw.Flush();
-};
-
-
-
-
+    sEllipses.Flush();
+    sSurfaceLines.Flush();
+}
 
 std::vector<ImFont*> gFonts(30, nullptr);
 GLFWwindow*          gMainWindow   = nullptr;
+FramePacer           gFramePacer;
 static float         sDisplayScale = 1.f;
 
 static void sCreateUI(GLFWwindow* window, const char* glslVersion = nullptr) {
@@ -167,7 +169,7 @@ static void sCreateUI(GLFWwindow* window, const char* glslVersion = nullptr) {
     ImGui::CreateContext();
 
     bool success;
-    success = ImGui_ImplGlfw_InitForOpenGL(window, false);
+    success = ImGui_ImplGlfw_InitForOpenGL(window, true);
     if (!success) {
         spdlog::error("ImGui_ImplGlfw_InitForOpenGL failed");
         assert(false);
@@ -190,7 +192,38 @@ static void sCreateUI(GLFWwindow* window, const char* glslVersion = nullptr) {
     }
 }
 
-static void UpdateUI() {}
+static void UpdateUI() {
+    ImGui::SetNextWindowPos(ImVec2(10.f, 10.f), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.8f);
+    ImGui::Begin("Anisotropy", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+    const double hRange[2]  = {1.0, 100.0};
+    const double krRange[2] = {1.0, 16.0};
+    const double knRange[2] = {0.1, 2.0};
+    ImGui::SliderScalar("h", ImGuiDataType_Double, &sParams.h, &hRange[0], &hRange[1], "%.1f");
+    ImGui::SliderScalar("kr", ImGuiDataType_Double, &sParams.kr, &krRange[0], &krRange[1], "%.2f");
+    ImGui::SliderScalar("kn", ImGuiDataType_Double, &sParams.kn, &knRange[0], &knRange[1], "%.2f");
+    ImGui::SliderInt("N_eps", &sParams.nEps, 0, 100);
+    // 1 is no neighborhood, the slider skips it
+    if (ImGui::SliderInt("k nearest (0: 2h)", &sParams.k, 0, 100) && sParams.k == 1) {
+        sParams.k = 0;
+    }
+    int kernel = (int)sParams.kernel;
+    if (ImGui::Combo("kernel", &kernel, sKernelNames, (int)KernelType::Count)) {
+        sParams.kernel = (KernelType)kernel;
+    }
+    const double isoRange[2]     = {0.05, 1.5};
+    const double spacingRange[2] = {0.0, 50.0};
+    ImGui::SliderScalar(
+        "iso", ImGuiDataType_Double, &sSurfaceParams.iso, &isoRange[0], &isoRange[1], "%.2f");
+    ImGui::SliderScalar("spacing (0: h/2)",
+                        ImGuiDataType_Double,
+                        &sSurfaceParams.spacing,
+                        &spacingRange[0],
+                        &spacingRange[1],
+                        "%.1f");
+    ImGui::Text("%d particles", gParticles.Size());
+    ImGui::End();
+}
 
 int main(int argc, char* argv[]) {
 
@@ -225,6 +258,7 @@ int main(int argc, char* argv[]) {
 
     glfwGetWindowContentScale(gMainWindow, &sDisplayScale, &sDisplayScale);
     glfwMakeContextCurrent(gMainWindow);
+    gFramePacer.SetVsync(false);
     int version = gladLoadGL(glfwGetProcAddress);
     printf("GL %d.%d\n", GLAD_VERSION_MAJOR(version), GLAD_VERSION_MINOR(version));
     printf(
@@ -233,17 +267,17 @@ int main(int argc, char* argv[]) {
     gDraw.Create();
 
     sCreateUI(gMainWindow, glslVersion);
+    sLoadParticles();
 
     glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
     glDisable(GL_DEPTH_TEST);
 
 
-    std::chrono::duration<double> frameTime(0.0);
-    std::chrono::duration<double> sleepAdjust(0.0);
 
 
     while (!glfwWindowShouldClose(gMainWindow)) {
-        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        gFramePacer.BeginFrame();
+        gProfiler.BeginFrame();
 
         glfwGetWindowSize(gMainWindow, &gCamera.mWidth, &gCamera.mHeight);
         spdlog::debug("width {}  height {}", gCamera.mWidth, gCamera.mHeight);
@@ -251,7 +285,7 @@ int main(int argc, char* argv[]) {
         glfwGetFramebufferSize(gMainWindow, &bufferWidth, &bufferHeight);
         glViewport(0, 0, bufferWidth, bufferHeight);
 
-//        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 
 
@@ -271,17 +305,18 @@ int main(int argc, char* argv[]) {
 
 
         UpdateUI();
+        gCamera.UpdateFromMouse();
 
-        static int hasDrawFirstFrame = 0;
-        if(!hasDrawFirstFrame){
-            sDrawSphParticles();
-            hasDrawFirstFrame = 1;
-        }
+        sUpdateAnisotropy();
+        sDrawSphParticles();
 
 
         if (false) {
             static std::string buffer;
-            buffer = std::to_string(1000.0 * frameTime.count()) + " ms.";
+            buffer = fmt::format("{:.2f} ms. p50 {:.2f} p99 {:.2f}",
+                                 1000.0 * gFramePacer.FrameTime().count(),
+                                 1000.0 * gFramePacer.Percentile(50),
+                                 1000.0 * gFramePacer.Percentile(99));
             gDraw.DrawString(Vec2{1350, 800}, buffer, 8.f);
         }
 
@@ -292,32 +327,23 @@ int main(int argc, char* argv[]) {
 
 
         glfwSwapBuffers(gMainWindow);
+        gProfiler.EndFrame();
 
 
 
 
         glfwPollEvents();
 
-        // Throttle to cap at 60Hz. This adaptive using a sleep adjustment. This could be improved
-        // by using mm_pause or equivalent for the last millisecond.
-        std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
-        std::chrono::duration<double>         target(1.0 / 60.0);
-        std::chrono::duration<double>         timeUsed  = t2 - t1;
-        std::chrono::duration<double>         sleepTime = target - timeUsed + sleepAdjust;
-        if (sleepTime > std::chrono::duration<double>(0)) {
-            std::this_thread::sleep_for(sleepTime);
-        }
-        std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
-        frameTime                                = t3 - t1;
-        spdlog::debug("SleepTime: {} ms,  frameTime: {} ms",
-                      1000.0 * sleepTime.count(),
-                      1000.0 * frameTime.count());
-
-
-        // Compute the sleep adjustment using a low pass filter
-        sleepAdjust = 0.9 * sleepAdjust + 0.1 * (target - frameTime);
+        // Cap at 60Hz: sleep until ~1ms before the deadline, then spin for the rest
+        gFramePacer.EndFrame();
+        spdlog::debug("frameTime: {} ms", 1000.0 * gFramePacer.FrameTime().count());
     }
 
+    gProfiler.Destroy();
+    // release the retained buffers while the context is alive
+    sEllipses     = LineBuffer();
+    sSurfaceLines = LineBuffer();
+    sPoints   = PointBuffer();
     gDraw.Destroy();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -3,29 +3,226 @@
 
 // Copyright (c) 2024 Tencent. All rights reserved.
 //
-#include <iostream>
-#include <Eigen/Dense>
 
-int main() {
-    Eigen::MatrixXd A(3,3);
-    A << 1, 2, 3,
-        4, 5, 6,
-        7, 8, 9;
+// Throughput and accuracy of the eigensolvers in SymEigen.h and of Eigen's own solvers against
+// Eigen's JacobiSVD<MatrixXd> (the reference row), on random covariance-like (symmetric positive
+// semi-definite) matrices. Errors are relative to the largest singular value of the reference.
+// usage: svd [matrix count]
 
-    std::cout << "Matrix A:\n" << A << std::endl << std::endl;
+#include "SymEigen.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
 
-    Eigen::JacobiSVD<Eigen::MatrixXd> svd(A, Eigen::ComputeThinU | Eigen::ComputeThinV);
+/// best of three runs, in nanoseconds per matrix
+static double sTime(int n, const std::function<void()>& run) {
+    double best = 1e30;
+    for (int k = 0; k < 3; k++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        double seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, seconds);
+    }
+    return 1e9 * best / n;
+}
+
+static void sReport(const char* name, double ns, double valueError, double reconstructionError) {
+    printf("%-32s %9.2f ns %9.2f M/s   value err %9.2e   reconstruction err %9.2e\n",
+           name,
+           ns,
+           1e3 / ns,
+           valueError,
+           reconstructionError);
+}
+
+/// the row the errors of the others are measured against
+static void sReportReference(const char* name, double ns) {
+    printf("%-32s %9.2f ns %9.2f M/s   value err %9s   reconstruction err %9s\n",
+           name,
+           ns,
+           1e3 / ns,
+           "ref",
+           "ref");
+}
+
+static void sBenchmark2(int n, std::mt19937& rng) {
+    std::uniform_real_distribution<double> angle(0.0, 2.0 * M_PI);
+    std::uniform_real_distribution<double> logScale(-6.0, 2.0);
+    std::vector<double>                    xx(n), xy(n), yy(n);
+    for (int i = 0; i < n; i++) {
+        double          s0 = std::exp(logScale(rng)), s1 = s0 * std::exp(logScale(rng) / 2.0);
+        Eigen::Matrix2d R  = Eigen::Rotation2Dd(angle(rng)).toRotationMatrix();
+        Eigen::Matrix2d C  = R * Eigen::Vector2d(s0, s1).asDiagonal() * R.transpose();
+        xx[i]              = C(0, 0);
+        xy[i]              = 0.5 * (C(0, 1) + C(1, 0));
+        yy[i]              = C(1, 1);
+    }
+    std::vector<double> l0(n), l1(n), c(n), s(n), ref0(n), ref1(n);
+    auto matrix = [&](int i) {
+        Eigen::Matrix2d C;
+        C << xx[i], xy[i], xy[i], yy[i];
+        return C;
+    };
+
+    printf("2x2, %d matrices\n", n);
+    double ns = sTime(n, [&]() {
+        for (int i = 0; i < n; i++) {
+            Eigen::JacobiSVD<Eigen::MatrixXd> svd(matrix(i), Eigen::ComputeThinU | Eigen::ComputeThinV);
+            ref0[i] = svd.singularValues()[0];
+            ref1[i] = svd.singularValues()[1];
+        }
+    });
+    sReportReference("JacobiSVD<MatrixXd>", ns);
+
+    auto errors = [&](double& valueError, double& reconstructionError) {
+        valueError = reconstructionError = 0.0;
+        for (int i = 0; i < n; i++) {
+            double scale = std::max(ref0[i], 1e-300);
+            valueError   = std::max(valueError,
+                                  std::max(std::abs(l0[i] - ref0[i]), std::abs(l1[i] - ref1[i])) / scale);
+            Eigen::Matrix2d U;
+            U << c[i], -s[i], s[i], c[i];
+            Eigen::Matrix2d C = U * Eigen::Vector2d(l0[i], l1[i]).asDiagonal() * U.transpose();
+            reconstructionError = std::max(reconstructionError, (C - matrix(i)).norm() / scale);
+        }
+    };
+    double valueError, reconstructionError;
 
-    Eigen::MatrixXd U = svd.matrixU();
-    Eigen::VectorXd singularValues = svd.singularValues();
-    Eigen::MatrixXd V = svd.matrixV();
+    ns = sTime(n, [&]() {
+        for (int i = 0; i < n; i++) {
+            Eigen::JacobiSVD<Eigen::Matrix2d> svd(matrix(i), Eigen::ComputeFullU);
+            l0[i] = svd.singularValues()[0];
+            l1[i] = svd.singularValues()[1];
+            c[i]  = svd.matrixU()(0, 0);
+            s[i]  = svd.matrixU()(1, 0);
+        }
+    });
+    errors(valueError, reconstructionError);
+    sReport("JacobiSVD<Matrix2d>", ns, valueError, reconstructionError);
 
-    std::cout << "Left singular vectors (U):\n" << U << std::endl << std::endl;
-    std::cout << "Singular values:\n" << singularValues << std::endl << std::endl;
-    std::cout << "Right singular vectors (V):\n" << V << std::endl << std::endl;
+    ns = sTime(n, [&]() {
+        for (int i = 0; i < n; i++) {
+            sSymEigen2(xx[i], xy[i], yy[i], l0[i], l1[i], c[i], s[i]);
+        }
+    });
+    errors(valueError, reconstructionError);
+    sReport("sSymEigen2", ns, valueError, reconstructionError);
 
-    Eigen::MatrixXd Sigma = U * singularValues.asDiagonal() * V.transpose();
-    std::cout << "Reconstructed matrix:\n" << Sigma << std::endl;
+    ns = sTime(n, [&]() {
+        sSymEigen2Batch(
+            xx.data(), xy.data(), yy.data(), n, l0.data(), l1.data(), c.data(), s.data());
+    });
+    errors(valueError, reconstructionError);
+#ifdef __AVX2__
+    sReport("sSymEigen2Batch (AVX2)", ns, valueError, reconstructionError);
+#else
+    sReport("sSymEigen2Batch (scalar)", ns, valueError, reconstructionError);
+#endif
+}
+
+static void sBenchmark3(int n, std::mt19937& rng) {
+    std::normal_distribution<double>       normal;
+    std::uniform_real_distribution<double> logScale(-6.0, 2.0);
+    std::vector<double>                    a[6];
+    for (auto& array : a) {
+        array.resize(n);
+    }
+    for (int i = 0; i < n; i++) {
+        Eigen::Matrix3d R =
+            Eigen::Quaterniond(normal(rng), normal(rng), normal(rng), normal(rng))
+                .normalized()
+                .toRotationMatrix();
+        double s0 = std::exp(logScale(rng));
+        Eigen::Vector3d sigma(s0, s0 * std::exp(logScale(rng) / 2.0), s0 * std::exp(logScale(rng) / 2.0));
+        // flat and thin kernels have repeated eigenvalues
+        if (i % 4 == 0) {
+            sigma[2] = sigma[1];
+        }
+        Eigen::Matrix3d C = R * sigma.asDiagonal() * R.transpose();
+        a[0][i] = C(0, 0), a[1][i] = C(0, 1), a[2][i] = C(0, 2);
+        a[3][i] = C(1, 1), a[4][i] = C(1, 2), a[5][i] = C(2, 2);
+    }
+    auto matrix = [&](int i) {
+        Eigen::Matrix3d C;
+        C << a[0][i], a[1][i], a[2][i], a[1][i], a[3][i], a[4][i], a[2][i], a[4][i], a[5][i];
+        return C;
+    };
+    std::vector<double> l[3], v[9], ref[3];
+    for (int k = 0; k < 3; k++) {
+        l[k].resize(n);
+        ref[k].resize(n);
+    }
+    for (auto& array : v) {
+        array.resize(n);
+    }
+
+    printf("3x3, %d matrices\n", n);
+    double ns = sTime(n, [&]() {
+        for (int i = 0; i < n; i++) {
+            Eigen::JacobiSVD<Eigen::MatrixXd> svd(matrix(i), Eigen::ComputeThinU | Eigen::ComputeThinV);
+            for (int k = 0; k < 3; k++) {
+                ref[k][i] = svd.singularValues()[k];
+            }
+        }
+    });
+    sReportReference("JacobiSVD<MatrixXd>", ns);
+
+    auto errors = [&](double& valueError, double& reconstructionError) {
+        valueError = reconstructionError = 0.0;
+        for (int i = 0; i < n; i++) {
+            Eigen::Vector3d lambda;
+            Eigen::Matrix3d V;
+            for (int k = 0; k < 3; k++) {
+                lambda[k]  = l[k][i];
+                valueError = std::max(valueError, std::abs(l[k][i] - ref[k][i]) / ref[0][i]);
+                for (int d = 0; d < 3; d++) {
+                    V(d, k) = v[3 * k + d][i];
+                }
+            }
+            Eigen::Matrix3d C   = V * lambda.asDiagonal() * V.transpose();
+            reconstructionError = std::max(reconstructionError, (C - matrix(i)).norm() / ref[0][i]);
+        }
+    };
+    // eigenvalues largest first and the eigenvectors, the output of sSymEigen3
+    auto store = [&](int i, const Eigen::Vector3d& lambda, const Eigen::Matrix3d& V) {
+        for (int k = 0; k < 3; k++) {
+            l[k][i] = lambda[k];
+            for (int d = 0; d < 3; d++) {
+                v[3 * k + d][i] = V(d, k);
+            }
+        }
+    };
+    double valueError, reconstructionError;
+
+    ns = sTime(n, [&]() {
+        for (int i = 0; i < n; i++) {
+            Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(matrix(i));
+            store(i, solver.eigenvalues().reverse(), solver.eigenvectors().rowwise().reverse());
+        }
+    });
+    errors(valueError, reconstructionError);
+    sReport("SelfAdjointEigenSolver", ns, valueError, reconstructionError);
+
+    ns = sTime(n, [&]() {
+        for (int i = 0; i < n; i++) {
+            Eigen::Vector3d lambda;
+            Eigen::Matrix3d V;
+            sSymEigen3(matrix(i), lambda, V);
+            store(i, lambda, V);
+        }
+    });
+    errors(valueError, reconstructionError);
+    sReport("sSymEigen3 (computeDirect)", ns, valueError, reconstructionError);
+}
 
+int main(int argc, char* argv[]) {
+    int          n = argc > 1 ? std::atoi(argv[1]) : 2000000;
+    std::mt19937 rng(2024);
+    sBenchmark2(n, rng);
+    sBenchmark3(n, rng);
     return 0;
 }